@@ -0,0 +1,144 @@
+//
+// Copyright (c) 2013 Daniel Iñigo, Efren Suarez, Yuriy Batrakov, José Sklatz
+//
+// Permission is hereby granted, free of charge, to any
+// person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the
+// Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the
+// Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice
+// shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+// KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+// PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+// OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+//
+// file: DecisionLog.cc
+// author: Daniel Iñigo
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <omnetpp.h>
+#ifndef _WIN32
+#include <sys/stat.h>
+#else
+#include <direct.h>
+#endif
+
+#include "DecisionLog.h"
+
+Register_PerRunConfigOption(CFGID_NOFREE_DECISION_LOG, "nofree-decision-log", CFG_FILENAME, "",
+        "Base de los ficheros binarios (uno por columna) con todas las decisiones de servir (vacío = no se registran).");
+
+FILE *DecisionLog::files[DL_NUM_COLUMNS];
+vector<char> DecisionLog::buffers[DL_NUM_COLUMNS];
+long DecisionLog::buffered = 0;
+long DecisionLog::written = 0;
+string DecisionLog::base;
+int DecisionLog::users = 0;
+
+/** Crea los directorios de la ruta (p.ej. results/ aún no existe al inicializar). */
+static void makeParentDirs( const string &path )
+{
+    for(size_t i = path.find('/', 1); i != string::npos; i = path.find('/', i+1)){
+        string dir = path.substr(0, i);
+#ifndef _WIN32
+        mkdir(dir.c_str(), 0777);
+#else
+        _mkdir(dir.c_str());
+#endif
+    }
+}
+
+string DecisionLog::baseName()
+{
+    return ev.getConfig()->getAsFilename(CFGID_NOFREE_DECISION_LOG);
+}
+
+void DecisionLog::open()
+{
+    if(users++ > 0) return;
+    base = baseName();
+    buffered = written = 0;
+    makeParentDirs(base);
+    for(int c=0; c<DL_NUM_COLUMNS; c++){
+        string file = base + "." + decisionColumnName(c) + ".col";
+        files[c] = fopen(file.c_str(), "wb");
+        if(files[c] == NULL){
+            while(--c >= 0) fclose(files[c]);
+            users = 0;
+            throw cRuntimeError("No se puede crear el registro de decisiones '%s'", file.c_str());
+        }
+        DecisionLogHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, "NOFREEDL", sizeof(header.magic));
+        header.version = DL_VERSION;
+        header.width   = decisionColumnWidth(c);
+        strncpy(header.column, decisionColumnName(c), sizeof(header.column)-1);
+        if(fwrite(&header, sizeof(header), 1, files[c]) != 1){
+            while(c >= 0) fclose(files[c--]);
+            users = 0;
+            throw cRuntimeError("Error al escribir el registro de decisiones '%s'", file.c_str());
+        }
+        buffers[c].clear();
+        buffers[c].reserve((size_t)BUFFER_RECORDS * header.width);
+    }
+}
+
+template<class T> void DecisionLog::put( int column, T value )
+{
+    vector<char> &buffer = buffers[column];
+    size_t n = buffer.size();
+    buffer.resize(n + sizeof(T));
+    memcpy(&buffer[n], &value, sizeof(T));
+}
+
+void DecisionLog::record( simtime_t t, int requester, int server, int total, int accepted, double ratio, int outcome )
+{
+    put<double>(DL_TIME, SIMTIME_DBL(t));
+    put<int32>(DL_REQUESTER, requester);
+    put<int32>(DL_SERVER, server);
+    put<int32>(DL_TOTAL, total);
+    put<int32>(DL_ACCEPTED, accepted);
+    put<double>(DL_RATIO, ratio);
+    put<uint8>(DL_OUTCOME, outcome);
+    if(++buffered >= BUFFER_RECORDS && !flush()){
+        throw cRuntimeError("Error al escribir el registro de decisiones '%s'", base.c_str());
+    }
+}
+
+bool DecisionLog::flush()
+{
+    bool ok = true;
+    for(int c=0; c<DL_NUM_COLUMNS; c++){
+        vector<char> &buffer = buffers[c];
+        if(!buffer.empty()) ok = fwrite(&buffer[0], 1, buffer.size(), files[c]) == buffer.size() && ok;
+        buffer.clear();
+    }
+    written += buffered;
+    buffered = 0;
+    return ok;
+}
+
+void DecisionLog::release()
+{
+    if(users == 0 || --users > 0) return;
+    // Se llama desde el destructor de los nodos: los errores sólo se avisan.
+    bool ok = flush();
+    for(int c=0; c<DL_NUM_COLUMNS; c++) ok = (fclose(files[c]) == 0) && ok;
+    if(!ok) EV << "Error al escribir el registro de decisiones " << base << endl;
+    else EV << written << " decisiones registradas en " << base << ".*.col" << endl;
+}
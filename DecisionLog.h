@@ -0,0 +1,84 @@
+//
+// Copyright (c) 2013 Daniel Iñigo, Efren Suarez, Yuriy Batrakov, José Sklatz
+//
+// Permission is hereby granted, free of charge, to any
+// person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the
+// Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the
+// Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice
+// shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+// KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+// PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+// OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+//
+// file: DecisionLog.h
+// author: Daniel Iñigo
+//
+
+#ifndef __DECISIONLOG_H_
+#define __DECISIONLOG_H_
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <omnetpp.h>
+#include "DecisionLogFormat.h"
+using namespace std;
+
+/**
+ * Registro binario de todas las decisiones de servir o no un archivo, para
+ * analizarlas fuera de la simulación (tools/read_decisions) sin pasar por
+ * los .vec ni por el log de texto.
+ *
+ * Se controla desde el ini:
+ *   nofree-decision-log = "base"   escribe base.time.col, base.requester.col...
+ * (vale con variables, p.ej. "${resultdir}/${configname}-${runnumber}").
+ *
+ * Es columnar (ver DecisionLogFormat.h): cada columna se acumula en memoria
+ * y se vuelca a su fichero cada BUFFER_RECORDS decisiones y al destruirse
+ * el último nodo. Todos los nodos escriben en los mismos ficheros, así que
+ * no es apto para simulación paralela.
+ */
+class DecisionLog
+{
+public:
+    /** Base de los ficheros ("" si no se registra). */
+    static string baseName ( );
+
+    /** Un nodo más escribe en el registro; el primero crea los ficheros. */
+    static void open ( );
+    /** Añade una decisión. */
+    static void record ( simtime_t t, int requester, int server, int total, int accepted, double ratio, int outcome );
+    /** Un nodo menos; con el último se vuelca lo pendiente y se cierran. */
+    static void release ( );
+
+private:
+    enum { BUFFER_RECORDS = 65536 };
+
+    /** Vuelca los buffers a los ficheros; false si falla alguna escritura. */
+    static bool flush ( );
+    template<class T> static void put ( int column, T value );
+
+    static FILE *files[DL_NUM_COLUMNS];
+    static vector<char> buffers[DL_NUM_COLUMNS];
+    static long buffered;       // Decisiones en los buffers.
+    static long written;        // Decisiones registradas en total.
+    static string base;
+    static int users;
+};
+
+#endif
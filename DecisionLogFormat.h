@@ -0,0 +1,85 @@
+//
+// Copyright (c) 2013 Daniel Iñigo, Efren Suarez, Yuriy Batrakov, José Sklatz
+//
+// Permission is hereby granted, free of charge, to any
+// person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the
+// Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the
+// Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice
+// shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+// KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+// PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+// OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+//
+// file: DecisionLogFormat.h
+// author: Daniel Iñigo
+//
+
+#ifndef __DECISIONLOGFORMAT_H_
+#define __DECISIONLOGFORMAT_H_
+
+// Sin dependencias de OmNet++: lo usan también las herramientas de tools/.
+#include <stdint.h>
+
+/**
+ * Formato del registro de decisiones (ver DecisionLog). Cada columna va en
+ * su propio fichero "<base>.<columna>.col": una cabecera DecisionLogHeader y
+ * detrás un valor de ancho fijo por decisión, en el orden de la máquina. La
+ * decisión k es el valor k de todas las columnas.
+ */
+enum DecisionColumn {
+    DL_TIME = 0,        // double: instante de la decisión.
+    DL_REQUESTER,       // int32: nodo que pide el archivo.
+    DL_SERVER,          // int32: nodo que decide.
+    DL_TOTAL,           // int32: peticiones totales reunidas del que pide.
+    DL_ACCEPTED,        // int32: peticiones aceptadas reunidas del que pide.
+    DL_RATIO,           // double: accepted/total (NaN si total es 0).
+    DL_OUTCOME,         // uint8: DecisionOutcome.
+    DL_NUM_COLUMNS
+};
+
+/** Bits de la columna outcome. */
+enum DecisionOutcome {
+    DL_SERVED    = 1,   // Se sirvió el archivo.
+    DL_NEW_NODE  = 2,   // No había reputación del que pide (se sirve por ser nuevo).
+    DL_FREERIDER = 4,   // El que pide es freerider (sólo para estadísticas).
+    DL_NO_QUERY  = 8    // Se decidió sin consultar a la red (push o caché de opiniones).
+};
+
+enum { DL_VERSION = 1 };
+
+struct DecisionLogHeader {
+    char magic[8];      // "NOFREEDL"
+    uint32_t version;
+    uint32_t width;     // Bytes por valor.
+    char column[16];    // Nombre de la columna.
+};
+
+/** Nombre (también la extensión del fichero) y ancho de cada columna. */
+inline const char *decisionColumnName(int c)
+{
+    static const char *const names[DL_NUM_COLUMNS] = { "time", "requester", "server", "total", "accepted", "ratio", "outcome" };
+    return names[c];
+}
+
+inline unsigned int decisionColumnWidth(int c)
+{
+    static const unsigned int widths[DL_NUM_COLUMNS] = { 8, 4, 4, 4, 4, 8, 1 };
+    return widths[c];
+}
+
+#endif
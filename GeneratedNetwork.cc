@@ -0,0 +1,228 @@
+//
+// Copyright (c) 2013 Daniel Iñigo, Efren Suarez, Yuriy Batrakov, José Sklatz
+//
+// Permission is hereby granted, free of charge, to any
+// person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the
+// Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the
+// Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice
+// shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+// KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+// PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+// OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+//
+// file: GeneratedNetwork.cc
+// author: Daniel Iñigo
+//
+
+#include <set>
+#include <string.h>
+#include <time.h>
+#include <omnetpp.h>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#include "GeneratedNetwork.h"
+
+Define_Module(GeneratedNetwork);
+
+using namespace std;
+
+/** Tiempo real (reloj monótono) en segundos. */
+static double wallSeconds()
+{
+#ifndef _WIN32
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+/** Clave única de una arista no dirigida, para no repetirla. */
+static int64 edgeKey(int a, int b)
+{
+    if(a > b) { int t = a; a = b; b = t; }
+    return ((int64)a << 32) | (int64)b;
+}
+
+void GeneratedNetwork::doBuildInside()
+{
+    buildStart = wallSeconds();
+    // Crea los nodos tal y como vienen en el NED.
+    cModule::doBuildInside();
+
+    int n = par("numNodes");
+    long m = par("numEdges");
+    if(m < 0) m = (long)(n * (double)par("meanDegree") / 2);
+    int k = (int)(double)par("meanDegree");
+    const char *model = par("model");
+    // Generador propio (xorshift64*) para que la topología dependa sólo de
+    // la semilla y no de los RNG que usen los nodos.
+    rngState = (uint64)(int)par("seed") * 0x9E3779B97F4A7C15ULL + 1;
+
+    edges.clear();
+    if(n > 1){
+        if(strcmp(model, "erdos-renyi") == 0)           generateErdosRenyi(n, m);
+        else if(strcmp(model, "barabasi-albert") == 0)  generateBarabasiAlbert(n, max(1, k/2));
+        else if(strcmp(model, "small-world") == 0)      generateSmallWorld(n, max(2, k), par("rewireProb"));
+        else throw cRuntimeError("Modelo de topología desconocido: \"%s\"", model);
+    }
+    connectEdges();
+
+    buildSeconds = wallSeconds() - buildStart;
+    EV << "GeneratedNetwork: " << n << " nodos, " << edges.size() << " aristas (" << model
+       << ") en " << buildSeconds << "s" << endl;
+}
+
+int GeneratedNetwork::randomInt( int n )
+{
+    rngState ^= rngState >> 12;
+    rngState ^= rngState << 25;
+    rngState ^= rngState >> 27;
+    return (int)((rngState * 2685821657736338717ULL) >> 33) % n;
+}
+
+double GeneratedNetwork::randomDouble()
+{
+    return randomInt(1 << 30) / (double)(1 << 30);
+}
+
+void GeneratedNetwork::generateErdosRenyi( int n, long m )
+{
+    set<int64> seen;
+    // Árbol aleatorio: cada nodo se une a uno anterior, así la red es conexa.
+    for(int i=1; i<n; i++){
+        int j = randomInt(i);
+        edges.push_back(Edge(j, i));
+        seen.insert(edgeKey(j, i));
+    }
+    // El resto de aristas al azar, sin repetir ni lazos.
+    long maxEdges = (long)n * (n - 1) / 2;
+    if(m > maxEdges) m = maxEdges;
+    while((long)edges.size() < m){
+        int a = randomInt(n);
+        int b = randomInt(n);
+        if(a == b || !seen.insert(edgeKey(a, b)).second) continue;
+        edges.push_back(Edge(a, b));
+    }
+}
+
+void GeneratedNetwork::generateBarabasiAlbert( int n, int k )
+{
+    // Cada arista aparece dos veces en "ends", elegir al azar de ahí es
+    // elegir un nodo con probabilidad proporcional a su grado.
+    vector<int> ends;
+    int core = min(n, k + 1);
+    // Núcleo inicial completamente conectado.
+    for(int i=0; i<core; i++){
+        for(int j=0; j<i; j++){
+            edges.push_back(Edge(j, i));
+            ends.push_back(i);
+            ends.push_back(j);
+        }
+    }
+    for(int i=core; i<n; i++){
+        set<int> targets;
+        while((int)targets.size() < k){
+            targets.insert(ends[randomInt(ends.size())]);
+        }
+        for(set<int>::const_iterator it = targets.begin(); it != targets.end(); ++it){
+            edges.push_back(Edge(*it, i));
+            ends.push_back(i);
+            ends.push_back(*it);
+        }
+    }
+}
+
+void GeneratedNetwork::generateSmallWorld( int n, int k, double beta )
+{
+    set<int64> seen;
+    // Anillo: cada nodo con sus k/2 siguientes.
+    for(int i=0; i<n; i++){
+        for(int d=1; d<=k/2 && d<n; d++){
+            int j = (i + d) % n;
+            if(seen.insert(edgeKey(i, j)).second) edges.push_back(Edge(i, j));
+        }
+    }
+    // Recableado: con probabilidad beta el extremo lejano pasa a ser otro al azar.
+    for(unsigned int e=0; e<edges.size(); e++){
+        if(randomDouble() >= beta) continue;
+        int a = edges[e].first;
+        int b = randomInt(n);
+        if(a == b || seen.find(edgeKey(a, b)) != seen.end()) continue;
+        seen.erase(edgeKey(a, edges[e].second));
+        seen.insert(edgeKey(a, b));
+        edges[e].second = b;
+    }
+}
+
+void GeneratedNetwork::connectEdges()
+{
+    int n = par("numNodes");
+    // Primero el grado de cada nodo para dimensionar las puertas de una vez.
+    vector<int> degree(n, 0);
+    for(unsigned int e=0; e<edges.size(); e++){
+        degree[edges[e].first]++;
+        degree[edges[e].second]++;
+    }
+    vector<cModule *> nodes(n);
+    for(int i=0; i<n; i++){
+        nodes[i] = getSubmodule("node", i);
+        nodes[i]->setGateSize("dataGate", degree[i]);
+    }
+    // Después se conecta cada arista con dos canales (uno por sentido).
+    cChannelType *channelType = cChannelType::get("nofreeriders.DataChannel");
+    vector<int> used(n, 0);
+    for(unsigned int e=0; e<edges.size(); e++){
+        int a = edges[e].first;
+        int b = edges[e].second;
+        int ga = used[a]++;
+        int gb = used[b]++;
+        cChannel *ab = channelType->create("channel");
+        cChannel *ba = channelType->create("channel");
+        nodes[a]->gate("dataGate$o", ga)->connectTo(nodes[b]->gate("dataGate$i", gb), ab, true);
+        nodes[b]->gate("dataGate$o", gb)->connectTo(nodes[a]->gate("dataGate$i", ga), ba, true);
+        ab->finalizeParameters();
+        ba->finalizeParameters();
+    }
+}
+
+void GeneratedNetwork::initialize( int stage )
+{
+    // Los submódulos se inicializan después que la red en cada etapa, así
+    // que en la segunda ya han terminado todos los nodos.
+    if(stage == 0) startupSeconds = 0;
+    else startupSeconds = wallSeconds() - buildStart;
+}
+
+void GeneratedNetwork::finish()
+{
+    recordScalar("Nodos", (int)par("numNodes"));
+    recordScalar("Aristas", edges.size());
+    recordScalar("Tiempo de construccion (s)", buildSeconds);
+    recordScalar("Tiempo de arranque (s)", startupSeconds);
+#ifndef _WIN32
+    // Pico de memoria del proceso (en Linux ru_maxrss va en kB).
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) == 0){
+        recordScalar("Memoria maxima (kB)", usage.ru_maxrss);
+    }
+#endif
+}
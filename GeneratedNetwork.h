@@ -0,0 +1,88 @@
+//
+// Copyright (c) 2013 Daniel Iñigo, Efren Suarez, Yuriy Batrakov, José Sklatz
+//
+// Permission is hereby granted, free of charge, to any
+// person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the
+// Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the
+// Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice
+// shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+// KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+// PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+// OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+//
+// file: GeneratedNetwork.h
+// author: Daniel Iñigo
+//
+
+#ifndef __GENERATEDNETWORK_H_
+#define __GENERATEDNETWORK_H_
+
+#include <vector>
+#include <omnetpp.h>
+using namespace std;
+
+/**
+ * Red cuya topología se genera en C++ a partir de parámetros (nº de nodos,
+ * aristas o grado medio, modelo y semilla) en vez de leerse de un NED
+ * estático. Crea los nodos con el NED y luego las conexiones dataGate.
+ */
+class GeneratedNetwork : public cModule
+{
+protected:
+    /** Arista no dirigida entre dos índices de nodo. */
+    typedef pair<int, int> Edge;
+
+    uint64 rngState;                // Estado del generador propio de la topología.
+    vector<Edge> edges;             // Aristas generadas.
+    double buildStart;              // Instante (reloj monótono) en que empezó a construirse.
+    double buildSeconds;            // Tiempo real en crear los nodos y conectarlos.
+    double startupSeconds;          // Tiempo real hasta tener además todos los nodos inicializados.
+
+    /**
+     * Crea los submódulos del NED y después genera y conecta las aristas.
+     */
+    virtual void doBuildInside ( );
+
+    /** Dos etapas: en la segunda ya se han inicializado todos los nodos. */
+    virtual int numInitStages ( ) const { return 2; }
+    virtual void initialize ( int stage );
+
+    /**
+     * Graba el tamaño de la red, el tiempo de construcción y de arranque y
+     * la memoria usada.
+     */
+    virtual void finish ( );
+
+    /** Número aleatorio en [0, n) con el generador de la topología. */
+    int randomInt ( int n );
+    /** Número aleatorio en [0, 1). */
+    double randomDouble ( );
+
+    /** Genera las aristas según el modelo pedido. */
+    void generateErdosRenyi ( int n, long m );
+    void generateBarabasiAlbert ( int n, int k );
+    void generateSmallWorld ( int n, int k, double beta );
+
+    /**
+     * Conecta todas las aristas con DataChannel. Dimensiona una sola vez el
+     * vector de puertas de cada nodo.
+     */
+    void connectEdges ( );
+};
+
+#endif
@@ -33,125 +33,479 @@
 #include <string.h>
 #include <map>
 #include <set>
+#include <algorithm>
+#include <functional>
 #include <omnetpp.h>
 #include <sstream>
 
 #include "NoFreeNode.h"
 #include "NoFreeMessage_m.h"
+#include "Snapshot.h"
+#include "DecisionLog.h"
 
 // Declara el módulo para que pueda usarse en el archivo de topología
 Define_Module(NoFreeNode);
 
 using namespace std;
 
-NoFreeNode::NoFreeNode() : NOBODY(-1) { }   //inicializa la cte nobody
+NoFreeNode::NoFreeNode() : NOBODY(-1)      //inicializa la cte nobody
+{
+    nodeMap = NULL;
+    downloadFileTimer = NULL;
+    digestTimer = NULL;
+    snapshotTimer = NULL;
+    snapshotLoaded = false;
+    timerWheel = NULL;
+    decisionLog = false;
+}
 
 NoFreeNode::~NoFreeNode()
 {
-    cancelAndDelete(reputationRequestTimer);
-    cancelAndDelete(fileRequestTimer);
+    unsubscribe(POST_MODEL_CHANGE, this);
+    // Cada sesión de servicio abierta tiene su timer.
+    for(map<int, ServeSession *>::iterator it = sessions.begin(); it != sessions.end(); ++it){
+        cancelAndDelete(it->second->timer);
+        delete it->second;
+    }
+    for(map<unsigned int, PendingDownload *>::iterator it = downloads.begin(); it != downloads.end(); ++it){
+        cancelAndDelete(it->second->timer);
+        delete it->second;
+    }
     cancelAndDelete(downloadFileTimer);
+    cancelAndDelete(digestTimer);
+    // Y cada enlace usado, su timer y lo que quedase en cola.
+    for(map<cGate *, TxQueue>::iterator it = txQueues.begin(); it != txQueues.end(); ++it){
+        for(unsigned int i=0; i<it->second.packets.size(); i++) delete it->second.packets[i];
+        cancelAndDelete(it->second.timer);
+    }
+    // Si aún no se había guardado la instantánea ya no se va a guardar.
+    if(snapshotTimer != NULL && snapshotTimer->isScheduled()) Snapshot::cancelNode();
+    cancelAndDelete(snapshotTimer);
+    if(snapshotLoaded) Snapshot::release();
+    if(decisionLog) DecisionLog::release();
+    delete nodeMap;
+    // Los mensajes libres son nuestros, se borran aquí.
+    for(int t=0; t<=FILE_ACK; t++){
+        for(unsigned int i=0; i<messagePool[t].size(); i++) delete messagePool[t][i];
+    }
 }
 
 void NoFreeNode::initialize()
 {
     /////////// VARIABLES PARA LA CLASE ///////////
-    // Indicadores de archivo pedido a este nodo y siendo servido por él.
-    nodeRequested = NOBODY;
-    nodeServed    = NOBODY;
+    // Si se arranca de una instantánea se mapea antes de nada: el primer
+    // nodo que llega devuelve los generadores a donde estaban al tomarla,
+    // antes de que ningún nodo saque números (par() volátiles incluidos).
+    string snapshot = Snapshot::loadFile();
+    if(!snapshot.empty()){
+        Snapshot::acquire(snapshot);
+        snapshotLoaded = true;
+    }
+    // Descargas pendientes.
+    downloadSeq = 0;
     // Lee los valores de las variables desde el archivo de topología.
     requiredShareRate       = par("requiredShareRate");
     reputationRequestTimeout= par("reputationRequestTimeout");
     fileRequestTimeout      = par("fileRequestTimeout");
     downloadFileTimeout     = par("downloadFileTimeout");
     freeriderRate                = par("freeriderRate");
+    maxOutstandingDownloads = par("maxOutstandingDownloads");
+    maxConcurrentServes     = par("maxConcurrentServes");
+    admissionQueueSize      = par("admissionQueueSize");
+    // Almacén de reputaciones con la implementación elegida.
+    nodeMap = ReputationStore::create(par("reputationStore").stringValue());
+    // Lista de mensajes libres para no reservar memoria en cada envío.
+    messagePoolSize = par("messagePoolSize");
+    // Caché de consultas vistas para no reenviar la misma petición dos veces.
+    querySeq = 0;
+    seenQueries.configure(par("seenCacheSize"), par("seenCacheTimeout"));
+    // Modo de difusión de la reputación: consultas ("pull") o lotes ("push").
+    pushMode       = strcmp(par("disseminationMode").stringValue(), "push") == 0;
+    digestDelta    = strcmp(par("digestEncoding").stringValue(), "delta") == 0;
+    digestInterval = par("digestInterval");
+    digestSize     = par("digestSize");
+    digestCursor   = NOBODY;
+    // Caché de las reputaciones reunidas en las consultas.
+    opinionCacheTimeout     = par("opinionCacheTimeout");
+    opinionCacheMinOpinions = par("opinionCacheMinOpinions");
+    opinionCacheSize        = par("opinionCacheSize");
+    // Búsqueda en anillos crecientes.
+    expandingRing     = par("expandingRing");
+    ringInitialTtl    = par("ringInitialTtl");
+    ringMaxTtl        = par("ringMaxTtl");
+    ringMinOpinions   = par("ringMinOpinions");
+    ringTimeoutPerHop = par("ringTimeoutPerHop");
+    // Las migas de camino inverso sólo hacen falta mientras se esperan
+    // respuestas: con anillos, lo que espera el anillo más grande más un
+    // salto de margen para las respuestas que vienen de lejos.
+    double reverseTimeout = reputationRequestTimeout;
+    if(expandingRing) reverseTimeout = max(reverseTimeout, (ringMaxTtl+1)*ringTimeoutPerHop);
+    reversePath.configure(par("seenCacheSize"), reverseTimeout);
+    // Transferencia de archivos en trozos (el tamaño se lee en cada archivo).
+    chunkSize         = par("chunkSize").longValue();
+    chunkWindow       = par("chunkWindow");
+    sizedControlPackets = par("sizedControlPackets");
+    if(chunkSize <= 0) throw cRuntimeError("chunkSize debe ser mayor que 0");
+    if(chunkWindow <= 0) throw cRuntimeError("chunkWindow debe ser mayor que 0");
+    // Los timer van a la rueda de la red si la tiene.
+    timerWheel = TimerWheel::get();
     // Instancia los timer con un mensaje descriptivo.
-    reputationRequestTimer  = new cMessage("reputationRequestTimer");
-    fileRequestTimer        = new cMessage("fileRequestTimer");
     downloadFileTimer       = new cMessage("downloadFileTimer");
     // Encolo la primera descarga dentro de un tiempo "downloadFileTimeout".
     downloadFileTimeout     = par("downloadFileTimeout");
-    // Decide si es un freerider a partir de la "bondad" del nodo.
-    isFreerider = (uniform(0,1)<freeriderRate)? true : false;
+    // Si se arranca de una instantánea se recupera la reputación y el flag
+    // (sin sacar el número que lo decide).
+    if(snapshotLoaded){
+        // Si falta el nodo la instantánea es de otra red (o de otro tamaño)
+        // y seguir daría una mezcla de estado restaurado y nuevo.
+        if(!Snapshot::restoreNode(getId(), isFreerider, *nodeMap)){
+            throw cRuntimeError("El nodo %d no está en la instantánea '%s'", getId(), snapshot.c_str());
+        }
+    }
+    // Si no, decide si es un freerider a partir de la "bondad" del nodo.
+    else isFreerider = (uniform(0,1)<freeriderRate)? true : false;
+    // Y si hay que guardarla se programa cuándo.
+    if(!Snapshot::saveFile().empty()){
+        snapshotTimer = new cMessage("snapshotTimer");
+        scheduleAt(Snapshot::saveTime(), snapshotTimer);
+        Snapshot::expectNode();
+    }
+    // Registro binario de las decisiones, si se ha pedido.
+    if(!DecisionLog::baseName().empty()){
+        DecisionLog::open();
+        decisionLog = true;
+    }
     // Watch de las variables de clase
-    WATCH(nodeRequested);
-    WATCH(nodeServed);
-    WATCH(tempReputation);
-    WATCH_SET(nodeContributed);
-    WATCH_MAP(nodeMap);
+    WATCH_PTRMAP(downloads);
+    WATCH_PTRMAP(sessions);
+    WATCH(*nodeMap);
     WATCH(freeriderRate);
     WATCH(isFreerider);
 
     /////////// VARIABLES PARA LOS LOG ///////////
     // Inicializa los contadores para los logs.
-    int countF  =0;
-    int countR  =0;
-    int countRR =0;
-    int countFR =0;
-    // Inicializa los vectores para los logs.
-    vectorF.setName("Archivos Recibidos");
-    vectorR.setName("Reputaciones Recibidas");
-    vectorRR.setName("Peticiones de Archivos");
-    vectorFR.setName("Peticiones de Reputaciones");
+    countF          = 0;
+    countRefused    = 0;
+    countFreeriderF = 0;
+    countR          = 0;
+    countRR         = 0;
+    countFR         = 0;
+    // Señales de los contadores (lo que se graba se decide en el NED/ini).
+    fileServedSignal                = registerSignal("fileServed");
+    fileRefusedSignal               = registerSignal("fileRefused");
+    freeriderServedSignal           = registerSignal("freeriderServed");
+    freeriderRequestReceivedSignal  = registerSignal("freeriderRequestReceived");
+    reputationReceivedSignal        = registerSignal("reputationReceived");
+    reputationRequestReceivedSignal = registerSignal("reputationRequestReceived");
+    fileRequestReceivedSignal       = registerSignal("fileRequestReceived");
     // WATCH para los contadores de mensajes.
     WATCH(countF);
+    WATCH(countRefused);
+    WATCH(countFreeriderF);
     WATCH(countR);
     WATCH(countRR);
     WATCH(countFR);
+    countDupRR         = 0;
+    countSuppressedFwd = 0;
+    countOrphanR       = 0;
+    countMsgNew        = 0;
+    countMsgReused     = 0;
+    countServeDropped  = 0;
+    queueDelayStats.setName("Espera en cola de admision");
+    countDownloadTimeout  = 0;
+    countDownloadDeferred = 0;
+    downloadLatencyStats.setName("Latencia de descarga");
+    countDigestSent    = 0;
+    countDigestEntries = 0;
+    decisionLatencyStats.setName("Latencia de decision");
+    reputationDigestReceivedSignal = registerSignal("reputationDigestReceived");
+    WATCH(countDigestSent);
+    WATCH_MAP(gossipMerged);
+    countOpinionCacheHit  = 0;
+    countOpinionCacheMiss = 0;
+    WATCH(countOpinionCacheHit);
+    WATCH(countOpinionCacheMiss);
+    countRingReissue = 0;
+    opinionsPerDecisionStats.setName("Opiniones por decision");
+    ringRadiusStats.setName("Radio de consulta");
+    WATCH(countRingReissue);
+    countTransferDone    = 0;
+    countTransferStalled = 0;
+    countFileAck         = 0;
+    countUploadDropped   = 0;
+    countBytesReceived   = 0;
+    maxTxQueue           = 0;
+    transferTimeStats.setName("Tiempo de transferencia");
+    transferThroughputStats.setName("Caudal de descarga (B/s)");
+    linkUtilizationStats.setName("Utilizacion de enlace");
+    WATCH(countTransferDone);
+    WATCH(countBytesReceived);
+    WATCH(countDupRR);
+    WATCH(countSuppressedFwd);
+    WATCH(countOrphanR);
+    WATCH(countMsgNew);
+    WATCH(countMsgReused);
+    WATCH(countServeDropped);
+    WATCH(countDownloadTimeout);
+    WATCH(countDownloadDeferred);
+
+    PROFILE_NODE_STARTED();
+
+    // Tabla de vecinos, se reconstruye si cambia la conectividad.
+    buildNeighborTable();
+    subscribe(POST_MODEL_CHANGE, this);
 
     // Si el nodo es un freerider le pone un icono de MALO
     if (isFreerider) getDisplayString().parse("i=old/comp_a");
     // Pone en cola el primer evento.
-    scheduleAt(simTime()+downloadFileTimeout, downloadFileTimer);
+    scheduleTimer(downloadFileTimer, downloadFileTimeout);
+    // En modo push los lotes salen cada digestInterval, desfasados entre nodos.
+    if(pushMode){
+        digestTimer = new cMessage("digestTimer");
+        scheduleTimer(digestTimer, uniform(0, digestInterval));
+    }
+}
+
+void NoFreeNode::buildNeighborTable()
+{
+    vector<Neighbor> old;
+    old.swap(neighbors);
+    neighborIndex.clear();
+    int n = gateSize("dataGate$o");
+    neighbors.reserve(n);
+    for(int i=0; i<n; i++){
+        cGate *g = gate("dataGate$o", i);
+        int peerId = NOBODY;
+        // Si la puerta ya estaba se conserva el vecino aprendido.
+        if(i < (int)old.size() && old[i].gate == g && g->isConnected()){
+            peerId = old[i].peerId;
+        }
+        // Si es nueva se saluda al otro lado. Nunca se mira el módulo vecino
+        // para que funcione igual si está en otra partición.
+        else if(g->isConnected()){
+            Hello *hmsg = allocMessage<Hello>(HELLO);
+            hmsg->setSourceNodeId(getId());
+            sendPacket(hmsg, g);
+        }
+        neighbors.push_back(Neighbor(g, peerId));
+        if(peerId != NOBODY) neighborIndex[peerId] = i;
+    }
+    neighborTableValid = true;
+    // Sin enlace con quien pidió no llegan más confirmaciones: se abandona.
+    for(map<int64, Upload>::iterator it = uploads.begin(); it != uploads.end(); ){
+        if(neighborGateIndex(it->second.requester) < 0){
+            countUploadDropped++;
+            uploads.erase(it++);
+        }
+        else ++it;
+    }
+}
+
+void NoFreeNode::handleHello( Hello *msg )
+{
+    PROFILE_SCOPE(HELLO);
+    int i = msg->getArrivalGate()->getIndex();
+    if(i < (int)neighbors.size()){
+        neighbors[i].peerId = msg->getSourceNodeId();
+        neighborIndex[neighbors[i].peerId] = i;
+    }
+    releaseMessage(msg);
+}
+
+void NoFreeNode::sendPacket( cPacket *pkt, cGate *g )
+{
+    // Sin canal con datarate el envío no ocupa el enlace.
+    cChannel *channel = g->findTransmissionChannel();
+    if(channel == NULL){
+        send(pkt, g);
+        return;
+    }
+    TxQueue &queue = txQueues[g];
+    if(queue.timer == NULL){
+        queue.gate  = g;
+        queue.timer = new cMessage("txTimer", TX_TIMER);
+        queue.timer->setContextPointer(&queue);
+    }
+    queue.packets.push_back(pkt);
+    if((int)queue.packets.size() > maxTxQueue) maxTxQueue = queue.packets.size();
+    if(!queue.timer->isScheduled()) transmitQueued(&queue);
+}
+
+void NoFreeNode::transmitQueued( TxQueue *queue )
+{
+    while(!queue->packets.empty()){
+        cChannel *channel = queue->gate->findTransmissionChannel();
+        // Si se ha desconectado el enlace lo que quedaba se pierde.
+        if(channel == NULL){
+            for(unsigned int i=0; i<queue->packets.size(); i++){
+                releaseMessage(check_and_cast<NoFreeMessage *>(queue->packets[i]));
+            }
+            queue->packets.clear();
+            return;
+        }
+        // Mientras transmite se espera a que acabe.
+        simtime_t finish = channel->getTransmissionFinishTime();
+        if(finish > simTime()){
+            scheduleAt(finish, queue->timer);
+            return;
+        }
+        cPacket *pkt = queue->packets.front();
+        queue->packets.pop_front();
+        queue->bytes += pkt->getByteLength();
+        send(pkt, queue->gate);
+        queue->busy += channel->getTransmissionFinishTime() - simTime();
+    }
+}
+
+int NoFreeNode::neighborGateIndex( int peerId )
+{
+    map<int, int>::const_iterator it = neighborIndex.find(peerId);
+    return (it != neighborIndex.end())? it->second : -1;
+}
+
+int64 NoFreeNode::messageBytes( int type ) const
+{
+    if(!sizedControlPackets) return 0;
+    const int64 header = 16;   // messageTipe, sourceNodeId, destinationNodeId, ttl.
+    switch(type){
+        case FILE_REQUEST:          return header + 5;     // requestId, freerider.
+        case REPUTATION_REQUEST:    return header + 12;    // targetNodeId, querySeq, radius.
+        case FILE_RESPONSE:         return header + 20;    // requestId, chunk, numChunks, fileSize.
+        case REPUTATION_RESPONSE:   return header + 16;    // targetNodeId, totales, aceptadas, querySeq.
+        case REPUTATION_DIGEST:     return header + 1;     // delta (+12 por entrada).
+        case FILE_ACK:              return header + 8;     // requestId, chunk.
+        default:                    return header;         // HELLO.
+    }
+}
+
+void NoFreeNode::releaseMessage( NoFreeMessage *msg )
+{
+    vector<NoFreeMessage *> &pool = messagePool[msg->getMessageTipe()];
+    if(pool.size() < messagePoolSize) pool.push_back(msg);
+    else delete msg;
+}
+
+void NoFreeNode::receiveSignal( cComponent *source, simsignal_t signalID, cObject *obj )
+{
+    if(dynamic_cast<cPostGateConnectNotification *>(obj)
+            || dynamic_cast<cPostGateDisconnectNotification *>(obj)
+            || dynamic_cast<cPostGateVectorResizeNotification *>(obj)){
+        neighborTableValid = false;
+    }
 }
 
 void NoFreeNode::fileRequest()
 {
+    // Encolo un nuevo evento dentro de un tiempo aleatorio.
+    downloadFileTimeout = par("downloadFileTimeout");
+    scheduleTimer(downloadFileTimer, downloadFileTimeout);
     // Elijo a la persona de entre los conectados a mi.
-    int n = gateSize("dataGate$o");
+    int n = neighbors.size();
     int k = intuniform(0,n-1);
+    int server = neighbors[k].peerId;
+    // Si la ventana está llena, aún no sé quién hay por esa puerta o ya
+    // espero un archivo de ese nodo no pido.
+    if((int)downloads.size() >= maxOutstandingDownloads || server == NOBODY || isDownloadingFrom(server)){
+        countDownloadDeferred++;
+        return;
+    }
+    // Apunto la descarga con su propio timer.
+    PendingDownload *download = new PendingDownload(downloadSeq++, server, simTime());
+    downloads[download->requestId] = download;
+    download->timer = new cMessage("fileRequestTimer", DOWNLOAD_TIMER);
+    download->timer->setContextPointer(download);
+    scheduleTimer(download->timer, fileRequestTimeout);
     // Construyo un paquete.
-    FileRequest *frmsg = new FileRequest();
-    // Recupero la ID del módulo conectado por esa puerta.
-    nodeRequested = gate("dataGate$o", k)->getNextGate()->getOwnerModule()->getId();
+    FileRequest *frmsg = allocMessage<FileRequest>(FILE_REQUEST);
     frmsg->setSourceNodeId(getId());
-    frmsg->setDestinationNodeId(nodeRequested);
+    frmsg->setDestinationNodeId(server);
+    frmsg->setRequestId(download->requestId);
+    frmsg->setFreerider(isFreerider);
     // Le envío una petición.
-    send(frmsg, "dataGate$o", k);
-    EV<<"Nodo["<<getIndex()<<"]:    FileRequest->Nodo["<<nodeRequested<<"]"<<endl;
-    // Si no tengo reputación del nodo al que pido, la creo.
-    if(nodeMap.find(nodeRequested) == nodeMap.end()){
-        nodeMap[nodeRequested] = PeerReputation();
-    }
-    // Aumento las peticiones totales del nodo al que he pedido.
-    nodeMap[nodeRequested].totalRequest++;      
-    // Encolo un nuevo evento dentro de un tiempo aleatorio.
-    downloadFileTimeout = par("downloadFileTimeout");
-    scheduleAt(simTime()+downloadFileTimeout, downloadFileTimer);
+    sendPacket(frmsg, neighbors[k].gate);
+    EV<<"Nodo["<<getIndex()<<"]:    FileRequest->Nodo["<<server<<"]"<<endl;
+    // Aumento las peticiones totales del nodo al que he pedido (si no tengo
+    // reputación del nodo al que pido, se crea).
+    nodeMap->get(server).totalRequest++;
+    noteReputationChange(server, 1, 0);
+}
+
+bool NoFreeNode::isDownloadingFrom( int server )
+{
+    for(map<unsigned int, PendingDownload *>::const_iterator it = downloads.begin(); it != downloads.end(); ++it){
+        if(it->second->server == server) return true;
+    }
+    return false;
+}
+
+void NoFreeNode::downloadTimeout( PendingDownload *download )
+{
+    countDownloadTimeout++;
+    if(download->receivedChunks > 0) countTransferStalled++;
+    downloads.erase(download->requestId);
+    delete download->timer;
+    delete download;
 }
 
 void NoFreeNode::handleTimerEvent( cMessage *msg )
 {
-    // Si no está conectado a ningún otro nodo no pedir archivos
-    if(gateSize("dataGate$o") == 0) return;
+    PROFILE_SCOPE(Profiler::TIMER);
+    // Toca guardar el estado en la instantánea (aunque el nodo esté aislado).
+    if(msg == snapshotTimer){
+        Snapshot::saveNode(getId(), isFreerider, *nodeMap);
+        return;
+    }
+    // Ha quedado libre un enlace con paquetes en cola.
+    if(msg->getKind() == TX_TIMER){
+        transmitQueued((TxQueue *)msg->getContextPointer());
+        return;
+    }
+    // Si no está conectado a ningún otro nodo no pedir archivos ni mandar
+    // reputaciones; las descargas y servicios pendientes sí se cierran.
+    if(msg == digestTimer || msg == downloadFileTimer){
+        if(neighbors.empty()) return;
+    }
+    // Toca enviar el lote de reputaciones a los vecinos.
+    if(msg == digestTimer){
+        sendReputationDigest();
+    }
     // Es hora de descargarse un archivo de alguien.
-    if(msg == downloadFileTimer){
+    else if(msg == downloadFileTimer){
         fileRequest();
     }
     // He pedido un archivo y no me lo han dado, pongo mala reputación.
-    else if(msg == fileRequestTimer){
-        if(nodeRequested != NOBODY){
-            nodeRequested = NOBODY;
-        }
+    else if(msg->getKind() == DOWNLOAD_TIMER){
+        downloadTimeout((PendingDownload *)msg->getContextPointer());
+    }
+    // Ha expirado el tiempo para recibir reputación de un nodo que se está
+    // atendiendo, decidir si se envía o no.
+    else if(msg->getKind() == SERVE_TIMER){
+        reputationTimeout((ServeSession *)msg->getContextPointer());
     }
-    // Ha expirado el tiempo para recibir reputación, decidir si se envía o no.
-    else if(msg == reputationRequestTimer){
-        reputationRequest();
+}
+
+void NoFreeNode::scheduleTimer( cMessage *timer, simtime_t delay )
+{
+    if(timerWheel != NULL){
+        timerWheel->schedule(this, timer, simTime()+delay);
+        return;
     }
+    if(timer->isScheduled()) cancelEvent(timer);
+    scheduleAt(simTime()+delay, timer);
+}
+
+void NoFreeNode::wheelTimerFired( cMessage *timer )
+{
+    Enter_Method_Silent();
+    if(!neighborTableValid) buildNeighborTable();
+    handleTimerEvent(timer);
 }
 
 void NoFreeNode::handleMessage( cMessage *msg )
 {
+    PROFILE_SCOPE(Profiler::DISPATCH);
+    // Si ha cambiado la conectividad se rehace la tabla de vecinos.
+    if(!neighborTableValid) buildNeighborTable();
     // Si es un automensaje vemos qué timer ha saltado.
     if(msg->isSelfMessage()){
         handleTimerEvent(msg);
@@ -159,10 +513,12 @@ void NoFreeNode::handleMessage( cMessage *msg )
     }
     // Se hace cast al tipo de mensaje que heredan todos los demás.
     NoFreeMessage *auxmsg = check_and_cast<NoFreeMessage *>(msg);
+    PROFILE_BYTES(auxmsg->getMessageTipe(), auxmsg->getByteLength());
     // Se checkea el TTL para ver si ha hecho demasiados saltos ya.
     int ttl = auxmsg->getTtl();
     if(ttl==0){
-        cancelAndDelete(msg);
+        PROFILE_TTL_DROP(0);
+        releaseMessage(auxmsg);
         return;
     }
     else auxmsg->setTtl(ttl-1);
@@ -190,157 +546,568 @@ void NoFreeNode::handleMessage( cMessage *msg )
         {
             Reputation *auxmsg = check_and_cast<Reputation *>(msg);
             handleReputationResponse(auxmsg);
+            break;
+        }
+        case HELLO:
+        {
+            Hello *auxmsg = check_and_cast<Hello *>(msg);
+            handleHello(auxmsg);
+            break;
+        }
+        case REPUTATION_DIGEST:
+        {
+            ReputationDigest *auxmsg = check_and_cast<ReputationDigest *>(msg);
+            handleReputationDigest(auxmsg);
+            break;
+        }
+        case FILE_ACK:
+        {
+            FileAck *auxmsg = check_and_cast<FileAck *>(msg);
+            handleFileAck(auxmsg);
         }
     }
 }
 
 void NoFreeNode::handleFileRequest( FileRequest *msg )
 {
+    PROFILE_SCOPE(FILE_REQUEST);
    // Registro de datos (total de peticiones de archivos recibidas).
     countFR++;
-    vectorFR.record(countFR);
+    emit(fileRequestReceivedSignal, 1L);
 
-    // Si ya estamos sirviendo a otro nodo o somos freerider salimos.
-    if(nodeServed != NOBODY || isFreerider){
-        cancelAndDelete(msg);
+    int requester = msg->getSourceNodeId();
+    int gateIndex = msg->getArrivalGate()->getIndex();
+    unsigned int requestId = msg->getRequestId();
+    bool freerider = msg->getFreerider();
+    if(freerider) emit(freeriderRequestReceivedSignal, 1L);
+    releaseMessage(msg);
+    // Si somos freerider no servimos nada.
+    if(isFreerider){
+        countRefused++;
+        emit(fileRefusedSignal, 1L);
         return;
     }
-    // Dentro de ahora mas el timer de reputation me mando el sms de repitationRequestTimer.
-    else scheduleAt(simTime()+reputationRequestTimeout, reputationRequestTimer);
-    // Borra la lista de nodos de los que se ha recibido reputación.
-    nodeContributed.clear();
-    // Mira a quien queremos servir.
-    nodeServed = msg->getSourceNodeId();
-    nodeServedGate = msg->getArrivalGate()->getIndex();
-    ev << "HandleFileReq: [" << nodeServed << "]-->[" << getId() << "]" << endl;
-    // Si ya tenemos almacenada reputacion de este nodo la usamos.
-    if(nodeMap.find(nodeServed) != nodeMap.end()){
-        tempReputation = nodeMap[nodeServed];
+    // Si ya estamos atendiendo a ese nodo se descarta.
+    if(sessions.find(requester) != sessions.end()){
+        countServeDropped++;
+        return;
+    }
+    // Si queda hueco se empieza a atender ya.
+    if((int)sessions.size() < maxConcurrentServes){
+        startServe(requester, gateIndex, requestId, freerider);
+    }
+    // Si no, se pone a la cola si cabe y si no se descarta.
+    else if((int)admissionQueue.size() < admissionQueueSize){
+        admissionQueue.push_back(PendingServe(requester, gateIndex, requestId, freerider, simTime()));
     }
-    // Si no, se borra la tempReputation que se tenia, ya que seria de uan vez anterior.
     else{
-        tempReputation=PeerReputation();
+        countServeDropped++;
     }
+}
+
+void NoFreeNode::startServe( int requester, int gateIndex, unsigned int requestId, bool freerider )
+{
+    ServeSession *session = new ServeSession(requester, gateIndex, requestId, freerider, simTime());
+    sessions[requester] = session;
+    ev << "HandleFileReq: [" << requester << "]-->[" << getId() << "]" << endl;
+    // Si ya tenemos almacenada reputacion de este nodo la usamos.
+    PeerReputation *known = nodeMap->find(requester);
+    if(known != NULL){
+        session->evidence = *known;
+    }
+    // En modo push se suma lo que nos han contado los vecinos y se decide ya,
+    // sin consultar a nadie.
+    if(pushMode){
+        map<int, PeerReputation>::const_iterator it = gossipMerged.find(requester);
+        if(it != gossipMerged.end()){
+            session->evidence.acceptedRequest += it->second.acceptedRequest;
+            session->evidence.totalRequest    += it->second.totalRequest;
+        }
+        reputationRequest(session);
+        return;
+    }
+    // Si hace poco que se preguntó por este nodo se decide con lo que se
+    // reunió sumado a nuestra reputación actual.
+    if(opinionCacheTimeout > 0){
+        if(lookupOpinionCache(requester, session->evidence)){
+            countOpinionCacheHit++;
+            reputationRequest(session);
+            return;
+        }
+        countOpinionCacheMiss++;
+    }
+    // Se pregunta a la red y se espera a las respuestas.
+    session->timer = new cMessage("reputationRequestTimer", SERVE_TIMER);
+    session->timer->setContextPointer(session);
+    session->radius = expandingRing? ringInitialTtl : NOFREE_DEFAULT_TTL;
+    sendReputationQuery(session);
+}
+
+void NoFreeNode::sendReputationQuery( ServeSession *session )
+{
+    // Dentro de ahora mas el timer de reputation me mando el sms de repitationRequestTimer.
+    scheduleTimer(session->timer, expandingRing? session->radius*ringTimeoutPerHop : reputationRequestTimeout);
     // Crea un mensaje ReputationRequest para el nodo que pide.
-    ReputationRequest *rrmsg = new ReputationRequest();
-    rrmsg->setSourceNodeId(getId());    // Asigna el origen
-    rrmsg->setTargetNodeId(nodeServed); // Asigna el objetivo que buscamos
-    // Reenvia copias del ReputationRequest a todos menos a quien.
-    for(int i=0; i<gateSize("dataGate$o"); i++){
-        if(msg->getArrivalGate()->getIndex() != i){
-            int destinationNodeId = gate("dataGate$o", i)->getNextGate()->getOwnerModule()->getId();
-            rrmsg->setDestinationNodeId(destinationNodeId);
-            send(rrmsg->dup(),"dataGate$o", i);
+    ReputationRequest *rrmsg = allocMessage<ReputationRequest>(REPUTATION_REQUEST);
+    rrmsg->setSourceNodeId(getId());            // Asigna el origen
+    rrmsg->setTargetNodeId(session->requester); // Asigna el objetivo que buscamos
+    rrmsg->setQuerySeq(querySeq++);             // Identifica la consulta (cada anillo es otra)
+    rrmsg->setTtl(session->radius);
+    rrmsg->setRadius(session->radius);
+    // Me apunto mi propia consulta para no reenviarla cuando me vuelva.
+    seenQueries.insert(makeQueryId(getId(), rrmsg->getQuerySeq()), -1, simTime());
+    // Reenvia el ReputationRequest a todos menos a quien.
+    floodMessage(rrmsg, session->gateIndex, NOBODY);
+}
+
+void NoFreeNode::reputationTimeout( ServeSession *session )
+{
+    if(expandingRing && session->radius < ringMaxTtl
+            && (int)session->contributed.size() < ringMinOpinions){
+        countRingReissue++;
+        // Lo ya reunido se conserva; los que contestaron en el anillo
+        // anterior vuelven a contestar pero no se suman dos veces.
+        session->radius = min(2*session->radius, ringMaxTtl);
+        sendReputationQuery(session);
+        return;
+    }
+    reputationRequest(session);
+}
+
+void NoFreeNode::endServe( ServeSession *session )
+{
+    sessions.erase(session->requester);
+    cancelAndDelete(session->timer);
+    delete session;
+    // Queda un hueco libre: se atiende al primero de la cola que siga sin atender.
+    while(!admissionQueue.empty() && (int)sessions.size() < maxConcurrentServes){
+        PendingServe next = admissionQueue.front();
+        admissionQueue.pop_front();
+        if(sessions.find(next.requester) != sessions.end()){
+            countServeDropped++;
+            continue;
         }
+        queueDelayStats.collect(simTime() - next.arrival);
+        startServe(next.requester, next.gateIndex, next.requestId, next.freerider);
     }
-    cancelAndDelete(rrmsg);
-    cancelAndDelete(msg);
 }
 
 void NoFreeNode::handleFileResponse( File *msg )
 {
+    PROFILE_SCOPE(FILE_RESPONSE);
+    // En archivos de varios trozos se confirma cada uno (aunque la descarga
+    // ya haya caducado) para que el que sirve no se quede esperando.
+    if(msg->getNumChunks() > 1){
+        FileAck *amsg = allocMessage<FileAck>(FILE_ACK);
+        amsg->setSourceNodeId(getId());
+        amsg->setDestinationNodeId(msg->getSourceNodeId());
+        amsg->setRequestId(msg->getRequestId());
+        amsg->setChunk(msg->getChunk());
+        sendPacket(amsg, neighbors[msg->getArrivalGate()->getIndex()].gate);
+    }
     // Para caundo me responden con el archivo, si aun no ha vencido el
     // temporizador avisa de que ha recibido y aumenta las peticiones aceptadas.
-    if(nodeRequested != NOBODY){
-        nodeMap[nodeRequested].acceptedRequest++;
-        nodeRequested = NOBODY;
+    map<unsigned int, PendingDownload *>::iterator it = downloads.find(msg->getRequestId());
+    if(it != downloads.end() && it->second->server == msg->getSourceNodeId()){
+        PendingDownload *download = it->second;
+        // El primer trozo dice que el nodo ha aceptado servir.
+        if(download->receivedChunks == 0){
+            nodeMap->get(download->server).acceptedRequest++;
+            noteReputationChange(download->server, 0, 1);
+            downloadLatencyStats.collect(simTime() - download->sentAt);
+        }
+        download->receivedChunks++;
+        countBytesReceived += msg->getByteLength() - messageBytes(FILE_RESPONSE);
+        // Con el último la descarga está completa.
+        if(download->receivedChunks >= msg->getNumChunks()){
+            simtime_t elapsed = simTime() - download->sentAt;
+            countTransferDone++;
+            transferTimeStats.collect(elapsed);
+            if(msg->getFileSize() > 0 && elapsed > 0){
+                transferThroughputStats.collect(msg->getFileSize() / SIMTIME_DBL(elapsed));
+            }
+            downloads.erase(it);
+            cancelAndDelete(download->timer);
+            delete download;
+        }
+        // Si no, se espera al siguiente trozo otro fileRequestTimeout.
+        else scheduleTimer(download->timer, fileRequestTimeout);
     }
     // Borra el mensaje.
-    cancelAndDelete(msg);
+    releaseMessage(msg);
+}
+
+void NoFreeNode::startUpload( ServeSession *session )
+{
+    Upload upload;
+    upload.requester = session->requester;
+    upload.requestId = session->requestId;
+    upload.fileSize  = par("fileSize").longValue();
+    upload.numChunks = (upload.fileSize > chunkSize)? (int)((upload.fileSize + chunkSize - 1) / chunkSize) : 1;
+    // Si ya no es vecino no se envía nada; si cabe en un trozo no hay nada
+    // que seguir.
+    if(!sendChunk(upload)){
+        countUploadDropped++;
+        return;
+    }
+    if(upload.numChunks == 1) return;
+    Upload &u = uploads[makeQueryId(upload.requester, upload.requestId)];
+    u = upload;
+    while(u.nextChunk < u.numChunks && u.inFlight < chunkWindow && sendChunk(u)) ;
+}
+
+bool NoFreeNode::sendChunk( Upload &upload )
+{
+    int g = neighborGateIndex(upload.requester);
+    if(g < 0) return false;
+    // Estos campos no son necesarios, pero podría implementarse un factory que lo hiciese por mi.
+    File *fmsg = allocMessage<File>(FILE_RESPONSE);
+    fmsg->setSourceNodeId(getId());
+    fmsg->setDestinationNodeId(upload.requester);
+    fmsg->setRequestId(upload.requestId);
+    fmsg->setChunk(upload.nextChunk);
+    fmsg->setNumChunks(upload.numChunks);
+    fmsg->setFileSize(upload.fileSize);
+    // El último trozo lleva lo que quede.
+    fmsg->addByteLength(min(chunkSize, upload.fileSize - upload.nextChunk*chunkSize));
+    sendPacket(fmsg, neighbors[g].gate);
+    upload.nextChunk++;
+    upload.inFlight++;
+    return true;
+}
+
+void NoFreeNode::handleFileAck( FileAck *msg )
+{
+    PROFILE_SCOPE(FILE_ACK);
+    countFileAck++;
+    map<int64, Upload>::iterator it = uploads.find(makeQueryId(msg->getSourceNodeId(), msg->getRequestId()));
+    if(it != uploads.end()){
+        Upload &upload = it->second;
+        upload.inFlight--;
+        if(upload.nextChunk < upload.numChunks){
+            if(!sendChunk(upload)){
+                countUploadDropped++;
+                uploads.erase(it);
+            }
+        }
+        else if(upload.inFlight == 0) uploads.erase(it);
+    }
+    releaseMessage(msg);
 }
 
 void NoFreeNode::handleReputationRequest( ReputationRequest *msg )
 {
+    PROFILE_SCOPE(REPUTATION_REQUEST);
     int targetNode = msg->getTargetNodeId();
 
     countRR++;
-    vectorRR.record(countRR);
+    emit(reputationRequestReceivedSignal, 1L);
+
+    // Si ya hemos visto esta consulta no se vuelve a contestar ni a reenviar.
+    int arrivalIndex = msg->getArrivalGate()->getIndex();
+    int64 queryId = makeQueryId(msg->getSourceNodeId(), msg->getQuerySeq());
+    if(!seenQueries.insert(queryId, arrivalIndex, simTime())){
+        countDupRR++;
+        countSuppressedFwd += neighbors.size() - 1;
+        PROFILE_TTL_DROP(msg->getTtl());
+        PROFILE_FANOUT(0);
+        releaseMessage(msg);
+        return;
+    }
+    // Recuerda por dónde llegó para devolver las respuestas por ahí.
+    reversePath.insert(queryId, arrivalIndex, simTime());
 
     // Si tenemos reputacion de este nodo la enviamos.
-    if(nodeMap.find(targetNode) != nodeMap.end()){
+    PeerReputation *known = nodeMap->find(targetNode);
+    if(known != NULL){
         // Crea un mensaje.
-        Reputation *rmsg = new Reputation();
+        Reputation *rmsg = allocMessage<Reputation>(REPUTATION_RESPONSE);
         rmsg->setTargetNodeId(msg->getTargetNodeId());
         rmsg->setSourceNodeId(getId());
         rmsg->setDestinationNodeId(msg->getSourceNodeId());
-        rmsg->setTotalRequests(nodeMap[targetNode].totalRequest);
-        rmsg->setAcceptedRequests(nodeMap[targetNode].acceptedRequest);
+        rmsg->setTotalRequests(known->totalRequest);
+        rmsg->setAcceptedRequests(known->acceptedRequest);
+        rmsg->setQuerySeq(msg->getQuerySeq());
+        // Tiene que poder deshacer tantos saltos como pudo dar la petición.
+        rmsg->setTtl(msg->getRadius());
         // La reenvia por la puerta que llegó.
-        send(rmsg,"dataGate$o", msg->getArrivalGate()->getIndex());
-    }
-    // Y la pedimos por todas las bocas menos por la que llegó:
-    for(int i=0; i<gateSize("dataGate$o"); i++){
-        if(msg->getArrivalGate()->getIndex() != i){
-            int destinationNodeId = gate("dataGate$o", i)->getNextGate()->getOwnerModule()->getId();
-            // Si el objetivo es el mismo que el destino no le envio la petición
-            if(targetNode != destinationNodeId){
-                msg->setDestinationNodeId(destinationNodeId);
-                send(msg->dup(),"dataGate$o", i);
-            }
-        }
+        sendPacket(rmsg, neighbors[arrivalIndex].gate);
     }
-    // Borra el mensaje original.
-    cancelAndDelete(msg);
+    // Y la pedimos por todas las bocas menos por la que llegó (ni al propio
+    // objetivo); el original sale por la última.
+    floodMessage(msg, arrivalIndex, targetNode);
 }
 
 void NoFreeNode::handleReputationResponse( Reputation *msg )
 {
-    // Si el mensaje de reputación es del nodo que he preguntado, y me lo mandaban a mi.
-    if((msg->getTargetNodeId() == nodeServed) && (msg->getDestinationNodeId() == getId())){
+    PROFILE_SCOPE(REPUTATION_RESPONSE);
+    // Si me lo mandaban a mi.
+    if(msg->getDestinationNodeId() == getId()){
+        // Si el mensaje de reputación es de un nodo al que estoy atendiendo.
+        map<int, ServeSession *>::iterator it = sessions.find(msg->getTargetNodeId());
+        if(it != sessions.end()){
+            ServeSession *session = it->second;
 
-        countR++;
-        vectorR.record(countR);
+            countR++;
+            emit(reputationReceivedSignal, 1L);
 
-        // Si aún no tengo sumada la opinión de ese nodo me la quedo.
-        if(nodeContributed.find(nodeServed) != nodeContributed.end()){
-            ev << "suma la opinión del nodo [" << nodeServed << "] a la que ya tengo " << tempReputation;
-            int a = msg->getAcceptedRequests();
-            int t = msg->getTotalRequests();
-            tempReputation = PeerReputation(a, t);
-            // Añado el nodo a la lista de los que han contribuido para no coger mas.
-            nodeContributed.insert(msg->getSourceNodeId());
+            // Si aún no tengo sumada la opinión de ese nodo me la quedo.
+            if(session->contributed.find(msg->getSourceNodeId()) == session->contributed.end()){
+                ev << "suma la opinión del nodo [" << msg->getSourceNodeId() << "] a la que ya tengo " << session->evidence;
+                int a = msg->getAcceptedRequests();
+                int t = msg->getTotalRequests();
+                session->remote.acceptedRequest   += a;
+                session->remote.totalRequest      += t;
+                session->evidence.acceptedRequest += a;
+                session->evidence.totalRequest    += t;
+                // Añado el nodo a la lista de los que han contribuido para no coger mas.
+                session->contributed.insert(msg->getSourceNodeId());
+            }
         }
     }
-    // Si no era para mi lo reenvío por todas las salidas menos la que llega.
+    // Si no era para mi lo devuelvo por donde llegó la petición.
     else{
-        for(int i=0; i<gateSize("dataGate$o"); i++){
-            if(msg->getArrivalGate()->getIndex() != i){
-                int destinationNodeId = gate("dataGate$o", i)->getNextGate()->getOwnerModule()->getId();
-                msg->setDestinationNodeId(destinationNodeId);
-                send(msg->dup(),"dataGate$o", i);
-            }
+        int64 queryId = makeQueryId(msg->getDestinationNodeId(), msg->getQuerySeq());
+        int backGate;
+        if(reversePath.lookup(queryId, simTime(), backGate)){
+            sendPacket(msg, neighbors[backGate].gate);
+            return;
+        }
+        // Sin camino de vuelta (ha caducado) ya nadie espera la respuesta.
+        countOrphanR++;
+        PROFILE_TTL_DROP(msg->getTtl());
+    }
+    // Borro el mensaje, que ya se ha procesado.
+    releaseMessage(msg);
+}
+
+bool NoFreeNode::lookupOpinionCache( int peer, PeerReputation &evidence )
+{
+    expireOpinionCache();
+    map<int, CachedOpinion>::iterator it = opinionCache.find(peer);
+    if(it == opinionCache.end()) return false;
+    evidence.acceptedRequest += it->second.remote.acceptedRequest;
+    evidence.totalRequest    += it->second.remote.totalRequest;
+    return true;
+}
+
+void NoFreeNode::storeOpinionCache( int peer, const CachedOpinion &opinion )
+{
+    expireOpinionCache();
+    // Si está llena se desaloja la más antigua (si el nodo ya estaba se
+    // sustituye sin desalojar a nadie).
+    if(opinionCacheSize > 0 && opinionCache.size() >= opinionCacheSize
+            && opinionCache.find(peer) == opinionCache.end()){
+        while(!opinionCacheOrder.empty()){
+            pair<int, simtime_t> oldest = opinionCacheOrder.front();
+            opinionCacheOrder.pop_front();
+            if(dropOpinionCache(oldest)) break;
+        }
+    }
+    opinionCache[peer] = opinion;
+    opinionCacheOrder.push_back(make_pair(peer, opinion.expiry));
+}
+
+void NoFreeNode::expireOpinionCache( )
+{
+    while(!opinionCacheOrder.empty() && opinionCacheOrder.front().second <= simTime()){
+        dropOpinionCache(opinionCacheOrder.front());
+        opinionCacheOrder.pop_front();
+    }
+}
+
+bool NoFreeNode::dropOpinionCache( const pair<int, simtime_t> &slot )
+{
+    // Si el nodo se volvió a guardar después, esta posición ya no es la suya.
+    map<int, CachedOpinion>::iterator it = opinionCache.find(slot.first);
+    if(it == opinionCache.end() || it->second.expiry != slot.second) return false;
+    opinionCache.erase(it);
+    return true;
+}
+
+void NoFreeNode::noteReputationChange( int peer, int totalDelta, int acceptedDelta )
+{
+    if(!pushMode) return;
+    PeerReputation &pending = digestPending[peer];
+    pending.totalRequest    += totalDelta;
+    pending.acceptedRequest += acceptedDelta;
+}
+
+void NoFreeNode::sendReputationDigest( )
+{
+    scheduleTimer(digestTimer, digestInterval);
+    if(digestPending.empty()) return;
+    // Se eligen las entradas: en delta las que siguen al último nodo enviado,
+    // dando la vuelta al llegar al final (el resto queda para el siguiente
+    // lote y ningún nodo se queda siempre fuera), en topk las que más han
+    // cambiado (el resto se olvida).
+    vector<pair<int, int> > chosen;     // (cambio, nodo)
+    map<int, PeerReputation>::const_iterator start = digestDelta? digestPending.upper_bound(digestCursor) : digestPending.begin();
+    for(map<int, PeerReputation>::const_iterator it = start; it != digestPending.end(); ++it){
+        chosen.push_back(make_pair(it->second.totalRequest + it->second.acceptedRequest, it->first));
+    }
+    for(map<int, PeerReputation>::const_iterator it = digestPending.begin(); it != start; ++it){
+        chosen.push_back(make_pair(it->second.totalRequest + it->second.acceptedRequest, it->first));
+    }
+    int n = min((int)chosen.size(), digestSize);
+    if(!digestDelta){
+        partial_sort(chosen.begin(), chosen.begin()+n, chosen.end(), greater<pair<int, int> >());
+    }
+    else if(n > 0) digestCursor = chosen[n-1].second;
+    ReputationDigest *dmsg = allocMessage<ReputationDigest>(REPUTATION_DIGEST);
+    dmsg->setSourceNodeId(getId());
+    dmsg->setDelta(digestDelta);
+    dmsg->setTargetNodeIdArraySize(n);
+    dmsg->setTotalRequestsArraySize(n);
+    dmsg->setAcceptedRequestsArraySize(n);
+    if(sizedControlPackets) dmsg->addByteLength(12 * n);
+    for(int k=0; k<n; k++){
+        int peer = chosen[k].second;
+        PeerReputation value = digestPending[peer];
+        if(digestDelta) digestPending.erase(peer);
+        else value = *nodeMap->find(peer);
+        dmsg->setTargetNodeId(k, peer);
+        dmsg->setTotalRequests(k, value.totalRequest);
+        dmsg->setAcceptedRequests(k, value.acceptedRequest);
+    }
+    if(!digestDelta) digestPending.clear();
+    countDigestEntries += n;
+    countDigestSent += floodMessage(dmsg, -1, NOBODY);
+}
+
+void NoFreeNode::handleReputationDigest( ReputationDigest *msg )
+{
+    PROFILE_SCOPE(REPUTATION_DIGEST);
+    emit(reputationDigestReceivedSignal, 1L);
+    int source = msg->getSourceNodeId();
+    for(unsigned int k=0; k<msg->getTargetNodeIdArraySize(); k++){
+        int target = msg->getTargetNodeId(k);
+        if(target == getId()) continue;
+        PeerReputation &opinion = gossipOpinions[((int64)target << 32) | (unsigned int)source];
+        PeerReputation &merged  = gossipMerged[target];
+        // Se quita la opinión anterior de ese vecino y se pone la nueva.
+        merged.totalRequest    -= opinion.totalRequest;
+        merged.acceptedRequest -= opinion.acceptedRequest;
+        if(msg->getDelta()){
+            opinion.totalRequest    += msg->getTotalRequests(k);
+            opinion.acceptedRequest += msg->getAcceptedRequests(k);
+        }
+        else{
+            opinion = PeerReputation(msg->getAcceptedRequests(k), msg->getTotalRequests(k));
         }
+        merged.totalRequest    += opinion.totalRequest;
+        merged.acceptedRequest += opinion.acceptedRequest;
     }
-    // Borro el mensaje original, que para eso se enviaron duplicados.
-    cancelAndDelete(msg);
+    releaseMessage(msg);
 }
 
-void NoFreeNode::reputationRequest( )
+void NoFreeNode::reputationRequest( ServeSession *session )
 {
+    decisionLatencyStats.collect(simTime() - session->started);
+    PeerReputation &evidence = session->evidence;
+    // Si se ha consultado a la red y han contestado suficientes se guarda.
+    if(session->timer != NULL){
+        opinionsPerDecisionStats.collect(session->contributed.size());
+        ringRadiusStats.collect(session->radius);
+    }
+    if(session->timer != NULL && opinionCacheTimeout > 0
+            && (int)session->contributed.size() >= opinionCacheMinOpinions){
+        storeOpinionCache(session->requester, CachedOpinion(session->remote, session->contributed.size(), simTime()+opinionCacheTimeout));
+    }
     // Calcular el ratio de compartición.
-    double rate = (double)tempReputation.acceptedRequest / (double)tempReputation.totalRequest;
+    double rate = (double)evidence.acceptedRequest / (double)evidence.totalRequest;
     // Si las peticiones totales dentro de la reputacion temporal que tengo es 0 es que es un nuevo.
-    bool isNewNode   = (tempReputation.totalRequest == 0)? true : false;
+    bool isNewNode   = (evidence.totalRequest == 0)? true : false;
     // Miro si el ratio es meyor que el necesario.
     bool isGoodRatio = (rate >= requiredShareRate)? true : false;
+    // Se apunta la decisión en el registro binario.
+    if(decisionLog){
+        int outcome = ((isNewNode || isGoodRatio)? DL_SERVED : 0) | (isNewNode? DL_NEW_NODE : 0)
+                | (session->freerider? DL_FREERIDER : 0) | ((session->timer == NULL)? DL_NO_QUERY : 0);
+        DecisionLog::record(simTime(), session->requester, getId(), evidence.totalRequest, evidence.acceptedRequest, rate, outcome);
+    }
     // Decide si el nodo al que servir es digno de ser servido.
     if(isNewNode || isGoodRatio){
-        // Estos campos no son necesarios, pero podría implementarse un factory que lo hiciese por mi.
-        File *fmsg = new File();
-        fmsg->setSourceNodeId(getId());
-        fmsg->setDestinationNodeId(nodeServed);
-        send(fmsg,"dataGate$o", nodeServedGate);
+        startUpload(session);
 
         countF++;
-        vectorF.record(countF);
+        emit(fileServedSignal, 1L);
+        if(session->freerider){
+            countFreeriderF++;
+            emit(freeriderServedSignal, 1L);
+        }
+    }
+    else{
+        countRefused++;
+        emit(fileRefusedSignal, 1L);
     }
-    // Ya se ha decidido si se sirve o no y el nodo queda libre para servir a otra persona.
-    nodeServed = NOBODY;
+    // Ya se ha decidido si se sirve o no y queda un hueco para servir a otra persona.
+    endServe(session);
 }
 
 void NoFreeNode::finish( )
 {
-    // TODO
+    // Las cuentas de mensajes salen de las señales (@statistic en el NED).
+    int decided = countF + countRefused;
+    recordScalar("Ratio de servicio", decided? (double)countF/decided : 0);
+    recordScalar("Ratio de servicio a freeriders", countF? (double)countFreeriderF/countF : 0);
+    recordScalar("Peticiones de Reputacion duplicadas", countDupRR);
+    recordScalar("Reenvios suprimidos", countSuppressedFwd);
+    recordScalar("Reputaciones sin camino de vuelta", countOrphanR);
+    recordScalar("Mensajes creados", countMsgNew);
+    recordScalar("Mensajes reutilizados", countMsgReused);
+    recordScalar("Peticiones de Archivos descartadas", countServeDropped);
+    recordScalar("Tasa de descarte de peticiones", countFR? (double)countServeDropped/countFR : 0);
+    queueDelayStats.record();
+    recordScalar("Descargas caducadas", countDownloadTimeout);
+    recordScalar("Descargas aplazadas", countDownloadDeferred);
+    downloadLatencyStats.record();
+    recordScalar("Descargas por segundo", simTime() > 0? downloadLatencyStats.getCount() / SIMTIME_DBL(simTime()) : 0);
+    recordScalar("Nodos con reputacion", nodeMap->size());
+    recordScalar("Memoria de reputacion (bytes)", nodeMap->memoryUsage());
+    recordScalar("Lotes de reputacion enviados", countDigestSent);
+    recordScalar("Entradas de reputacion enviadas", countDigestEntries);
+    decisionLatencyStats.record();
+    recordScalar("Decisiones", decisionLatencyStats.getCount());
+    recordScalar("Latencia de decision acumulada (s)", decisionLatencyStats.getSum());
+    long lookups = countOpinionCacheHit + countOpinionCacheMiss;
+    recordScalar("Aciertos de cache de opiniones", countOpinionCacheHit);
+    recordScalar("Fallos de cache de opiniones", countOpinionCacheMiss);
+    recordScalar("Tasa de aciertos de cache de opiniones", lookups? (double)countOpinionCacheHit/lookups : 0);
+    recordScalar("Consultas ampliadas", countRingReissue);
+    opinionsPerDecisionStats.record();
+    ringRadiusStats.record();
+    recordScalar("Opiniones reunidas", opinionsPerDecisionStats.getSum());
+    // Transferencias y ocupación de cada enlace de salida.
+    recordScalar("Descargas completas", countTransferDone);
+    recordScalar("Descargas interrumpidas", countTransferStalled);
+    recordScalar("Confirmaciones de trozo recibidas", countFileAck);
+    recordScalar("Envios de archivo abandonados", countUploadDropped);
+    recordScalar("Bytes recibidos", countBytesReceived);
+    recordScalar("Caudal recibido (B/s)", simTime() > 0? countBytesReceived / SIMTIME_DBL(simTime()) : 0);
+    transferTimeStats.record();
+    recordScalar("Tiempo de transferencia acumulado (s)", transferTimeStats.getSum());
+    transferThroughputStats.record();
+    int64 bytesSent = 0;
+    double busy = 0;
+    for(unsigned int i=0; i<neighbors.size(); i++){
+        if(!neighbors[i].gate->isConnected()) continue;
+        double linkBusy = 0;
+        map<cGate *, TxQueue>::const_iterator it = txQueues.find(neighbors[i].gate);
+        if(it != txQueues.end()){
+            linkBusy   = SIMTIME_DBL(it->second.busy);
+            bytesSent += it->second.bytes;
+        }
+        busy += linkBusy;
+        if(simTime() > 0) linkUtilizationStats.collect(linkBusy / SIMTIME_DBL(simTime()));
+    }
+    linkUtilizationStats.record();
+    recordScalar("Enlaces", linkUtilizationStats.getCount());
+    recordScalar("Tiempo de transmision (s)", busy);
+    recordScalar("Bytes enviados", bytesSent);
+    recordScalar("Maximo de paquetes en cola de enlace", maxTxQueue);
+    // El último nodo graba el resumen de la instrumentación (si está activa).
+    PROFILE_NODE_FINISHED();
 }
 
 /**
@@ -352,6 +1119,22 @@ ostream& operator<<(ostream& os, const PeerReputation& p)
     return os << "(" << p.acceptedRequest << "/" << p.totalRequest << ")";
 }
 
+/**
+ * Operador salida estandar para poder usar el WATCH_PTRMAP() con las sesiones.
+ */
+ostream& operator<<(ostream& os, const ServeSession& s)
+{
+    return os << "puerta " << s.gateIndex << ", " << s.evidence << " de " << s.contributed.size() << " nodos";
+}
+
+/**
+ * Operador salida estandar para poder usar el WATCH_PTRMAP() con las descargas.
+ */
+ostream& operator<<(ostream& os, const PendingDownload& d)
+{
+    return os << "nodo " << d.server << " desde t=" << d.sentAt;
+}
+
 /**
  * Operador entrada estandar para poder usar el WATCH_MAP() en modo r/w
  */
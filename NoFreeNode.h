@@ -36,58 +36,247 @@
 #include <string.h>
 #include <map>
 #include <set>
+#include <vector>
+#include <deque>
 #include <omnetpp.h>
 #include "NoFreeMessage_m.h"
+#include "QueryCache.h"
+#include "ReputationStore.h"
+#include "Profiler.h"
+#include "TimerWheel.h"
 using namespace std;
 
 /**
- * Clase muy básica para almacenar la reputación
+ * Entrada de la tabla de vecinos: puerta de salida y nodo al otro lado.
  */
-struct PeerReputation {
-    int acceptedRequest;    // Peticiones aceptadas.
-    int totalRequest;       // Peticiones aceptadas.
-    /** Constructor por defecto */
-    PeerReputation() {acceptedRequest=0; totalRequest=0;}
-    /** Constructor con parámetros */
-    PeerReputation(int a, int t) {acceptedRequest=a; totalRequest=t;}
+struct Neighbor {
+    cGate *gate;            // Puerta dataGate$o por la que se llega al vecino.
+    int peerId;             // Id del módulo vecino (NOBODY hasta recibir su Hello).
+    Neighbor(cGate *g, int p) : gate(g), peerId(p) { }
 };
 
-class NoFreeNode : public cSimpleModule
+/**
+ * Tipos (kind) de los timers que se crean por sesión o por descarga; el
+ * contexto del timer apunta a su ServeSession o PendingDownload.
+ */
+enum TimerKind {
+    SERVE_TIMER = 1,
+    DOWNLOAD_TIMER = 2,
+    TX_TIMER = 3                // Fin de la transmisión en curso de un enlace (contexto: su TxQueue).
+};
+
+/**
+ * Archivo pedido del que aún se espera respuesta.
+ */
+struct PendingDownload {
+    unsigned int requestId;     // Nº de la petición (viaja en FileRequest y File).
+    int server;                 // Nodo al que se ha pedido el archivo.
+    simtime_t sentAt;           // Cuándo se pidió (para medir la latencia).
+    int receivedChunks;         // Trozos del archivo recibidos.
+    cMessage *timer;            // Timer para esperar a que me sirvan el archivo (o el
+                                // siguiente trozo). Funciona con fileRequestTimeout.
+    PendingDownload(unsigned int r, int s, simtime_t t) : requestId(r), server(s), sentAt(t), receivedChunks(0), timer(NULL) { }
+};
+
+ostream& operator<<(ostream& os, const PendingDownload& d);
+
+/**
+ * Petición de archivo que se está atendiendo: se espera a reunir la
+ * reputación del que pide para decidir si se le sirve.
+ */
+struct ServeSession {
+    int requester;              // Nodo al que se va a enviar el archivo.
+    int gateIndex;              // Índice de la puerta por la que servir el archivo.
+    unsigned int requestId;     // Nº de la petición que se atiende.
+    bool freerider;             // Si quien pide es freerider (sólo para estadísticas).
+    simtime_t started;          // Cuándo se empezó a atender (para medir la decisión).
+    int radius;                 // TTL de la última consulta lanzada.
+    PeerReputation evidence;    // Reputación reunida del nodo que pide (la nuestra más remote).
+    PeerReputation remote;      // Suma de las opiniones recibidas de otros nodos.
+    set <int> contributed;      // Nodos que han aportado su reputación.
+    cMessage *timer;            // Timer para esperar mensajes de reputación.
+                                // Funciona con reputationRequestTimeout.
+    ServeSession(int r, int g, unsigned int id, bool f, simtime_t t) : requester(r), gateIndex(g), requestId(id), freerider(f), started(t), radius(0), timer(NULL) { }
+};
+
+ostream& operator<<(ostream& os, const ServeSession& s);
+
+/**
+ * Suma de las opiniones de otros nodos reunida en una consulta, que se
+ * reutiliza hasta que caduca en vez de volver a consultar por el mismo nodo
+ * (la reputación propia no se guarda, se toma la actual al decidir).
+ */
+struct CachedOpinion {
+    PeerReputation remote;      // Suma de las opiniones recibidas.
+    int opinions;               // Nodos que la aportaron.
+    simtime_t expiry;           // Hasta cuándo vale.
+    CachedOpinion() : opinions(0) { }
+    CachedOpinion(const PeerReputation &r, int o, simtime_t t) : remote(r), opinions(o), expiry(t) { }
+};
+
+/**
+ * Archivo que se está sirviendo en trozos: como mucho chunkWindow trozos
+ * enviados sin confirmar.
+ */
+struct Upload {
+    int requester;              // Nodo al que se envía (la puerta sale de la tabla de vecinos).
+    unsigned int requestId;     // Nº de la petición que se sirve.
+    int64 fileSize;             // Tamaño del archivo.
+    int numChunks;              // Trozos en que va.
+    int nextChunk;              // Siguiente trozo por enviar.
+    int inFlight;               // Trozos enviados sin confirmar.
+    Upload() : requester(-1), requestId(0), fileSize(0), numChunks(0), nextChunk(0), inFlight(0) { }
+};
+
+/**
+ * Cola de salida de un enlace: lo que se envía mientras el canal está
+ * transmitiendo espera aquí a que acabe en vez de dar error.
+ */
+struct TxQueue {
+    cGate *gate;                // Puerta dataGate$o del enlace.
+    deque <cPacket *> packets;  // Paquetes esperando, por orden de envío.
+    cMessage *timer;            // Vence al acabar la transmisión en curso.
+    simtime_t busy;             // Tiempo transmitiendo (para la utilización del enlace).
+    int64 bytes;                // Bytes enviados por el enlace.
+    TxQueue() : gate(NULL), timer(NULL), bytes(0) { }
+};
+
+/**
+ * Petición de archivo en cola esperando a que quede una sesión libre.
+ */
+struct PendingServe {
+    int requester;              // Nodo que pide.
+    int gateIndex;              // Puerta por la que llegó la petición.
+    unsigned int requestId;     // Nº de la petición.
+    bool freerider;             // Si quien pide es freerider (sólo para estadísticas).
+    simtime_t arrival;          // Cuándo llegó (para medir la espera).
+    PendingServe(int r, int g, unsigned int id, bool f, simtime_t t) : requester(r), gateIndex(g), requestId(id), freerider(f), arrival(t) { }
+};
+
+class NoFreeNode : public cSimpleModule, public cListener, public TimerClient
 {
 protected:
-    const int NOBODY;                   // Cuando no atendemos a un nodo ponemos este valor
-                                        // en los nodeRequested y nodeServed.
-    PeerReputation tempReputation;      // Almacena temporalmente la reputación
-                                        // de un nodo para decidir si servirle o no.
+    const int NOBODY;                   // Cuando no hay nodo (p.ej. puerta sin conectar)
+                                        // se pone este valor.
     double requiredShareRate;           // Ratio necesario de reputación para compartir (p.ej: 0.8);
-    int nodeRequested;                  // Nodo al que se ha pedido el archivo.
-    int nodeServed;                     // Nodo al que se va a enviar el archivo.
-    int nodeServedGate;                 // Id de la puerta por la que servir el archivo.
-    set <int> nodeContributed;          // Lista de nodos que han aportado su reputación.
+    map <unsigned int, PendingDownload *> downloads;
+                                        // Descargas pedidas sin respuesta, por nº de petición.
+    unsigned int downloadSeq;           // Siguiente nº de petición de archivo.
+    int maxOutstandingDownloads;        // Máximo de descargas pedidas a la vez.
+    map <int, ServeSession *> sessions; // Peticiones que se están atendiendo, por nodo que pide.
+    deque <PendingServe> admissionQueue;// Peticiones esperando a que quede una sesión libre.
+    int maxConcurrentServes;            // Máximo de nodos atendidos a la vez.
+    int admissionQueueSize;             // Máximo de peticiones en cola (0 = sin cola).
     double downloadFileTimeout;         // Tiempo hasta que se realize peticion
     double reputationRequestTimeout;    // Tiempo que se esperan msg tipo R.
     double fileRequestTimeout;          // Tiempo que se espera a que se sirva
                                         // un archivo (después se considera al servidor un freerider)
     double freeriderRate;               // Probabilidad de enviar el archivo
                                         // <0.8 freerider, >0.8 buen peer.
-    cMessage *reputationRequestTimer;   // Timer para esperar mensajes de reputación.
-                                        // Funciona con reputationRequestTimeout.
-    cMessage *fileRequestTimer;         // Timer para esperar a que me sirvan un archivo.
-                                        // Funciona con fileRequestTimeout.
     cMessage *downloadFileTimer;        // Timer para encolar nuevas peticiones de archivo.
-    map <int, PeerReputation> nodeMap;  // Lista de nodos adyacentes y su reputación.
+    ReputationStore *nodeMap;           // Lista de nodos conocidos y su reputación
+                                        // (implementación según "reputationStore").
     bool isFreerider;                   // Almacena si es freerider o no.
-    //Contadores de paquetes
-    int countF;                         //numero de archivos recibidos
+    unsigned int querySeq;              // Siguiente nº de secuencia para los ReputationRequest propios.
+    QueryCache seenQueries;             // ReputationRequest ya vistos (se descartan las repeticiones).
+    vector <Neighbor> neighbors;        // Tabla de vecinos indexada por puerta (dataGate$o[i]),
+                                        // los ids se aprenden de los Hello recibidos.
+    map <int, int> neighborIndex;       // Id de vecino -> índice de puerta.
+    bool neighborTableValid;            // Falso si ha cambiado la conectividad desde que se construyó.
+    vector <NoFreeMessage *> messagePool[FILE_ACK+1];
+                                        // Mensajes libres para reutilizar, por tipo.
+    unsigned int messagePoolSize;       // Máximo de mensajes libres por tipo.
+    QueryCache reversePath;             // Puerta por la que llegó cada consulta, para devolver
+                                        // las respuestas por el camino inverso.
+    bool pushMode;                      // Reputación por lotes periódicos a los vecinos ("push")
+                                        // en vez de consultar en cada petición ("pull").
+    bool digestDelta;                   // Lotes con incrementos ("delta") o con los valores
+                                        // de los K nodos que más han cambiado ("topk").
+    double digestInterval;              // Tiempo entre lotes.
+    int digestSize;                     // Máximo de entradas por lote.
+    cMessage *digestTimer;              // Timer para enviar el siguiente lote.
+    map <int, PeerReputation> digestPending;
+                                        // Cambios en nodeMap aún no enviados, por nodo.
+    int digestCursor;                   // Último nodo enviado en modo delta; el siguiente lote
+                                        // empieza por el que le sigue.
+    map <int64, PeerReputation> gossipOpinions;
+                                        // Última opinión de cada vecino sobre cada nodo,
+                                        // por (nodo << 32 | vecino).
+    map <int, PeerReputation> gossipMerged;
+                                        // Suma de las opiniones de los vecinos, por nodo.
+    map <int, CachedOpinion> opinionCache;
+                                        // Reputación reunida en consultas recientes, por nodo.
+    deque <pair<int, simtime_t> > opinionCacheOrder;
+                                        // (nodo, caducidad) en orden de inserción, que es
+                                        // también el de caducidad.
+    unsigned int opinionCacheSize;      // Máximo de nodos en la caché (0 = sin límite).
+    double opinionCacheTimeout;         // Tiempo que vale una entrada (0 = sin caché).
+    int opinionCacheMinOpinions;        // Opiniones necesarias para guardar una consulta.
+    bool expandingRing;                 // Consultar en anillos crecientes en vez de a un radio fijo.
+    int ringInitialTtl;                 // Radio de la primera consulta.
+    int ringMaxTtl;                     // Radio máximo (se dobla en cada anillo hasta él).
+    int ringMinOpinions;                // Opiniones con las que se deja de ampliar.
+    double ringTimeoutPerHop;           // Espera de cada anillo por salto de radio.
+    int64 chunkSize;                    // Bytes por trozo de archivo.
+    int chunkWindow;                    // Trozos enviados sin confirmar por archivo.
+    bool sizedControlPackets;           // Los mensajes llevan la longitud de su cabecera y campos.
+    map <int64, Upload> uploads;        // Archivos sirviéndose, por (nodo << 32 | nº de petición).
+    map <cGate *, TxQueue> txQueues;    // Cola de salida de cada enlace usado.
+    cMessage *snapshotTimer;            // Timer para guardar la instantánea (NULL si no se guarda).
+    bool snapshotLoaded;                // Si se restauró el estado de una instantánea.
+    TimerWheel *timerWheel;             // Rueda de la red para los timers (NULL = FES).
+    bool decisionLog;                   // Si se registran las decisiones (DecisionLog).
+    //Contadores de paquetes (cada uno con su señal)
+    int countF;                         //numero de archivos servidos
+    int countRefused;                   //numero de archivos denegados
+    int countFreeriderF;                //numero de archivos servidos a freeriders
     int countR;                         //numero de reputaciones recividas
     int countRR;                        //peticion de reputacion
     int countFR;                        //peticion de archivo
-
-    //defino los vectores que se utilizaran para loguear los datos
-    cOutVector vectorF, vectorR, vectorRR, vectorFR;
+    simsignal_t fileServedSignal;
+    simsignal_t fileRefusedSignal;
+    simsignal_t freeriderServedSignal;
+    simsignal_t freeriderRequestReceivedSignal;
+    simsignal_t reputationReceivedSignal;
+    simsignal_t reputationRequestReceivedSignal;
+    simsignal_t fileRequestReceivedSignal;
+    int countDupRR;                     //peticiones de reputacion duplicadas descartadas
+    int countSuppressedFwd;             //reenvios ahorrados al descartar duplicados
+    int countOrphanR;                   //reputaciones descartadas por no tener camino de vuelta
+    long countMsgNew;                   //mensajes creados con new
+    long countMsgReused;                //mensajes sacados de la lista de libres
+    int countServeDropped;              //peticiones de archivo descartadas (sin hueco o ya atendiendo a ese nodo)
+    cStdDev queueDelayStats;            //espera en la cola de admision
+    int countDownloadTimeout;           //descargas que no llegaron a tiempo
+    int countDownloadDeferred;          //descargas no pedidas por estar la ventana llena
+    cStdDev downloadLatencyStats;       //latencia FileRequest->File de las descargas
+    long countDigestSent;               //lotes de reputacion enviados
+    long countDigestEntries;            //entradas enviadas en los lotes
+    cStdDev decisionLatencyStats;       //tiempo desde que se atiende una peticion hasta decidir
+    simsignal_t reputationDigestReceivedSignal;
+    long countOpinionCacheHit;          //decisiones tomadas con la cache de opiniones
+    long countOpinionCacheMiss;         //consultas lanzadas por no estar en la cache
+    long countRingReissue;              //consultas relanzadas con mas radio
+    cStdDev opinionsPerDecisionStats;   //opiniones reunidas en cada decision tras consultar
+    cStdDev ringRadiusStats;            //radio con el que se decide cada consulta
+    long countTransferDone;             //descargas completas (todos los trozos)
+    long countTransferStalled;          //descargas que caducaron a medias
+    long countFileAck;                  //confirmaciones de trozo recibidas
+    long countUploadDropped;            //envios de archivo abandonados por perder al vecino
+    int64 countBytesReceived;           //bytes de archivo recibidos en descargas vivas
+    int maxTxQueue;                     //mayor cola de salida de un enlace
+    cStdDev transferTimeStats;          //tiempo desde que se pide un archivo hasta tenerlo entero
+    cStdDev transferThroughputStats;    //bytes/s de cada descarga completa
+    cStdDev linkUtilizationStats;       //fraccion del tiempo transmitiendo de cada enlace
 
 
 public:
+    /** Tabla de reputación del nodo (para el análisis global de TrustAnalyzer). */
+    const ReputationStore &getReputationStore ( ) const { return *nodeMap; }
+
+    /** Si el nodo es freerider (para el análisis global de TrustAnalyzer). */
+    bool isFreeriderNode ( ) const { return isFreerider; }
+
     /**
      * Constructor por defecto.
      */
@@ -108,6 +297,80 @@ public:
      */
     virtual void initialize ();
 
+    /**
+     * Recorre las puertas dataGate$o y construye la tabla de vecinos, para no
+     * tener que buscar puertas por nombre en cada envío. Por las puertas
+     * nuevas se envía un Hello para que el vecino aprenda nuestro id. Los
+     * archivos que se servían a quien ya no es vecino se abandonan (sus
+     * confirmaciones no van a llegar).
+     */
+    virtual void buildNeighborTable ( );
+
+    /**
+     * Recibe el saludo de un vecino y apunta su id en la tabla de vecinos.
+     */
+    virtual void handleHello ( Hello *msg );
+
+    /**
+     * Devuelve el índice de puerta por el que se llega al vecino dado o -1 si
+     * no es adyacente.
+     */
+    int neighborGateIndex ( int peerId );
+
+    /**
+     * Envía el paquete por la puerta dada. Si el canal está transmitiendo
+     * (o ya hay cola) el paquete espera en la cola del enlace.
+     */
+    void sendPacket ( cPacket *pkt, cGate *g );
+
+    /**
+     * Ha acabado la transmisión en curso del enlace: se envía lo que haya
+     * en cola hasta volver a ocuparlo.
+     */
+    virtual void transmitQueued ( TxQueue *queue );
+
+    /**
+     * Bytes en el enlace de un mensaje de ese tipo sin datos: la cabecera
+     * común (tipo, origen, destino y ttl) más sus campos fijos, o 0 si no
+     * está activado sizedControlPackets. Las listas del ReputationDigest y
+     * los datos del File se suman aparte.
+     */
+    int64 messageBytes ( int type ) const;
+
+    /**
+     * Devuelve un mensaje nuevo del tipo T (cuyo messageTipe es type),
+     * reutilizando uno de la lista de libres si lo hay, con la longitud de
+     * messageBytes(type).
+     */
+    template<class T> T *allocMessage ( int type );
+
+    /**
+     * Devuelve una copia del mensaje sacada de la lista de libres (equivale
+     * a dup() pero sin reservar memoria si hay mensajes libres).
+     */
+    template<class T> T *copyMessage ( T *msg );
+
+    /**
+     * Envía el mensaje por todas las puertas salvo exceptIndex, la que
+     * lleva a skipPeer y las de vecino aún desconocido, poniendo en cada
+     * copia el destino. Por la última
+     * puerta sale el original en vez de una copia; si no sale por ninguna
+     * se devuelve a la lista de libres. Devuelve cuántas puertas se usaron.
+     */
+    template<class T> int floodMessage ( T *msg, int exceptIndex, int skipPeer );
+
+    /**
+     * Devuelve a la lista de libres un mensaje que ya no se usa (o lo borra
+     * si la lista está llena).
+     */
+    void releaseMessage ( NoFreeMessage *msg );
+
+    /**
+     * Marca la tabla de vecinos para reconstruir cuando cambia la
+     * conectividad del nodo (se conecta, desconecta o redimensiona una puerta).
+     */
+    virtual void receiveSignal ( cComponent *source, simsignal_t signalID, cObject *obj );
+
     /**
      * Recibe un mensaje, mira del tipo que es (RR, FR, R o timer) y
      * delega su procesado a la función correspondiente.
@@ -120,6 +383,18 @@ public:
      */
     virtual void handleTimerEvent ( cMessage *msg );
 
+    /**
+     * Programa un timer para dentro de delay: en la rueda de la red si la
+     * hay y si no como automensaje.
+     */
+    void scheduleTimer ( cMessage *timer, simtime_t delay );
+
+    /**
+     * Ha vencido en la rueda un timer del nodo: se trata igual que si
+     * hubiera llegado como automensaje.
+     */
+    virtual void wheelTimerFired ( cMessage *timer );
+
     /**
      * Recibe una petición para servir un archivo que desencadena el proceso
      * de decision. Habrá que mirar si se tiene la reputación del nodo
@@ -130,11 +405,56 @@ public:
     virtual void handleFileRequest  ( FileRequest *msg );
 
     /**
-     * Recibe el archivo que había pedido así que incrementa 1 el contador de
-     * "acceptedRequests".
+     * Abre una sesión para atender la petición de archivo del nodo dado:
+     * arranca su timer y lanza la petición de reputación.
+     */
+    virtual void startServe ( int requester, int gateIndex, unsigned int requestId, bool freerider );
+
+    /**
+     * Lanza la petición de reputación de la sesión con TTL session->radius
+     * y programa su timer: reputationRequestTimeout, o en anillos
+     * ringTimeoutPerHop por salto.
+     */
+    virtual void sendReputationQuery ( ServeSession *session );
+
+    /**
+     * Ha vencido la espera de la sesión: en anillos, si hay pocas opiniones
+     * y no se ha llegado a ringMaxTtl, se pregunta con el doble de radio; si
+     * no, se decide con la suma de las opiniones de todos los anillos.
+     */
+    virtual void reputationTimeout ( ServeSession *session );
+
+    /**
+     * Cierra la sesión y, si hay peticiones en cola, atiende a la siguiente.
+     */
+    virtual void endServe ( ServeSession *session );
+
+    /**
+     * Recibe un trozo del archivo que había pedido. Con el primero incrementa
+     * 1 el contador de "acceptedRequests" del nodo al que se pidió (buscando
+     * por el nº de petición; si ya había caducado se ignora) y con el último
+     * da la descarga por completa. Si hay varios trozos confirma cada uno.
      */
     virtual void handleFileResponse ( File *msg );
 
+    /**
+     * Empieza a servir el archivo de la sesión: le da tamaño y envía los
+     * primeros trozos (hasta chunkWindow).
+     */
+    virtual void startUpload ( ServeSession *session );
+
+    /**
+     * Envía el siguiente trozo del archivo por la puerta del vecino que lo
+     * pidió (aunque se haya rehecho la tabla). Devuelve false si ya no es
+     * vecino, y entonces el envío se abandona.
+     */
+    virtual bool sendChunk ( Upload &upload );
+
+    /**
+     * Recibe la confirmación de un trozo y, si quedan, envía el siguiente.
+     */
+    virtual void handleFileAck ( FileAck *msg );
+
     /**
      * Recibe una petición de reputación para un nodo. Mira si la tiene, si no
      * lo tiene reenvía el mensaje.
@@ -144,28 +464,132 @@ public:
     /**
      * Recibe la reputación que había pedido y decide si servir o no el archivo
      * en función de lo que haya recibido y de un parámetro de "kindness"
-     * decide enviar el archivo o no.
+     * decide enviar el archivo o no. Si no era para este nodo la devuelve por
+     * la puerta por la que llegó la petición (camino inverso).
      */
     virtual void handleReputationResponse ( Reputation *msg );
 
+    /**
+     * Busca en la caché las opiniones reunidas de un nodo; si las hay y no
+     * han caducado las suma a evidence y devuelve true.
+     */
+    bool lookupOpinionCache ( int peer, PeerReputation &evidence );
+
+    /**
+     * Guarda las opiniones reunidas de un nodo; si la caché está llena se
+     * desaloja la entrada más antigua, como en QueryCache.
+     */
+    void storeOpinionCache ( int peer, const CachedOpinion &opinion );
+
+    /** Quita de la caché de opiniones las entradas caducadas. */
+    void expireOpinionCache ( );
+
+    /**
+     * Quita el nodo de una posición de la cola de la caché si sigue siendo
+     * la suya; devuelve false si se había vuelto a guardar después.
+     */
+    bool dropOpinionCache ( const pair<int, simtime_t> &slot );
+
+    /**
+     * Apunta un cambio en la reputación que tenemos de un nodo para enviarlo
+     * en el siguiente lote (sólo en modo push).
+     */
+    void noteReputationChange ( int peer, int totalDelta, int acceptedDelta );
+
+    /**
+     * Envía a todos los vecinos un lote con los cambios pendientes: en modo
+     * delta los incrementos (hasta digestSize siguiendo a los del lote
+     * anterior, el resto espera al siguiente),
+     * en modo topk los valores de los digestSize nodos que más han cambiado.
+     */
+    virtual void sendReputationDigest ( );
+
+    /**
+     * Mezcla las opiniones de un lote de un vecino con las que ya se tenían.
+     */
+    virtual void handleReputationDigest ( ReputationDigest *msg );
+
     /**
      * Transcurrido un tiempo aleatorio pide un archivo a otro nodo.
      * Aumenta en uno el contador de peticiones totales a ese nodo.
      * Se elije un nodo aleatoriamente entre los nodos conectados (recorrer
-     * el array de puertas y elegir uno).
+     * el array de puertas y elegir uno). Si ya hay maxOutstandingDownloads
+     * descargas pendientes, o ya se espera algo de ese nodo, no se pide.
      */
     virtual void fileRequest ( );
 
+    /**
+     * Indica si hay una descarga pendiente pedida a ese nodo.
+     */
+    bool isDownloadingFrom ( int server );
+
+    /**
+     * Ha vencido el tiempo de una descarga sin recibir el archivo: se olvida
+     * (el nodo ya tenía contada la petición en totalRequest).
+     */
+    virtual void downloadTimeout ( PendingDownload *download );
+
     /**
      * Petición de reputación: al principio se hará empleando el array de nodos
      * directamente y buscando pero luego se usará un algoritmo de flooding.
+     * Se decide con la reputación reunida en la sesión y se cierra.
      */
-    virtual void reputationRequest ( );
+    virtual void reputationRequest ( ServeSession *session );
 
     /**
-     * Graba estadísticas y logs.
+     * Graba estadísticas y logs: los escalares que no salen de las señales
+     * (ratio de servicio, descartes, memoria...).
      */
     virtual void finish ( );
 };
 
+template<class T> T *NoFreeNode::allocMessage( int type )
+{
+    vector<NoFreeMessage *> &pool = messagePool[type];
+    if(pool.empty()){
+        countMsgNew++;
+        T *msg = new T();
+        msg->setByteLength(messageBytes(type));
+        return msg;
+    }
+    countMsgReused++;
+    T *msg = check_and_cast<T *>(pool.back());
+    pool.pop_back();
+    msg->setTtl(NOFREE_DEFAULT_TTL);
+    msg->setByteLength(messageBytes(type));
+    return msg;
+}
+
+template<class T> T *NoFreeNode::copyMessage( T *msg )
+{
+    T *copy = allocMessage<T>(msg->getMessageTipe());
+    *copy = *msg;
+    return copy;
+}
+
+template<class T> int NoFreeNode::floodMessage( T *msg, int exceptIndex, int skipPeer )
+{
+    int last = -1;
+    int sent = 0;
+    for(int i=0; i<(int)neighbors.size(); i++){
+        // Por las puertas sin vecino conocido (aún sin Hello) no se envía.
+        if(i == exceptIndex || neighbors[i].peerId == NOBODY || neighbors[i].peerId == skipPeer) continue;
+        // La puerta anterior lleva copia, el original se guarda para la última.
+        if(last >= 0){
+            msg->setDestinationNodeId(neighbors[last].peerId);
+            sendPacket(copyMessage(msg), neighbors[last].gate);
+            sent++;
+        }
+        last = i;
+    }
+    if(last >= 0){
+        msg->setDestinationNodeId(neighbors[last].peerId);
+        sendPacket(msg, neighbors[last].gate);
+        sent++;
+    }
+    else releaseMessage(msg);
+    PROFILE_FANOUT(sent);
+    return sent;
+}
+
 #endif
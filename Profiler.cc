@@ -0,0 +1,161 @@
+//
+// Copyright (c) 2013 Daniel Iñigo, Efren Suarez, Yuriy Batrakov, José Sklatz
+//
+// Permission is hereby granted, free of charge, to any
+// person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the
+// Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the
+// Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice
+// shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+// KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+// PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+// OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+//
+// file: Profiler.cc
+// author: Daniel Iñigo
+//
+
+#ifdef NOFREE_PROFILE
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <omnetpp.h>
+
+#include "Profiler.h"
+#include "NoFreeMessage_m.h"
+
+int Profiler::liveNodes = 0;
+long Profiler::calls[NUM_HANDLERS];
+int64 Profiler::nanos[NUM_HANDLERS];
+long Profiler::degreeCalls[MAX_DEGREE+1];
+int64 Profiler::degreeNanos[MAX_DEGREE+1];
+long Profiler::fanoutHist[MAX_FANOUT+1];
+long Profiler::ttlHist[MAX_TTL+1];
+long Profiler::typeCount[NUM_HANDLERS];
+int64 Profiler::typeBytes[NUM_HANDLERS];
+
+/** Nombre de cada manejador para los escalares. */
+static const char *handlerName(int h)
+{
+    switch(h){
+        case FILE_REQUEST:          return "handleFileRequest";
+        case REPUTATION_REQUEST:    return "handleReputationRequest";
+        case FILE_RESPONSE:         return "handleFileResponse";
+        case REPUTATION_RESPONSE:   return "handleReputationResponse";
+        case HELLO:                 return "handleHello";
+        case REPUTATION_DIGEST:     return "handleReputationDigest";
+        case FILE_ACK:              return "handleFileAck";
+        case Profiler::DISPATCH:    return "handleMessage";
+        default:                    return "handleTimerEvent";
+    }
+}
+
+int64 Profiler::now()
+{
+    // Tiempo de CPU del hilo: no cuenta lo que el proceso pasa sin CPU
+    // (otros procesos, paginación), que con un reloj de pared se sumaría
+    // al manejador que estuviera en curso.
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (int64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void Profiler::nodeStarted()
+{
+    if(liveNodes++ > 0) return;
+    memset(calls, 0, sizeof(calls));
+    memset(nanos, 0, sizeof(nanos));
+    memset(degreeCalls, 0, sizeof(degreeCalls));
+    memset(degreeNanos, 0, sizeof(degreeNanos));
+    memset(fanoutHist, 0, sizeof(fanoutHist));
+    memset(ttlHist, 0, sizeof(ttlHist));
+    memset(typeCount, 0, sizeof(typeCount));
+    memset(typeBytes, 0, sizeof(typeBytes));
+}
+
+void Profiler::handlerCall( int handler, int degree, int64 nanoseconds )
+{
+    calls[handler]++;
+    nanos[handler] += nanoseconds;
+    // handleMessage ya incluye al manejador, no se cuenta dos veces por grado.
+    if(handler == DISPATCH) return;
+    if(degree > MAX_DEGREE) degree = MAX_DEGREE;
+    degreeCalls[degree]++;
+    degreeNanos[degree] += nanoseconds;
+}
+
+void Profiler::fanout( int copies )
+{
+    fanoutHist[copies > MAX_FANOUT? MAX_FANOUT : copies]++;
+}
+
+void Profiler::ttlDrop( int ttl )
+{
+    if(ttl < 0) ttl = 0;
+    ttlHist[ttl > MAX_TTL? MAX_TTL : ttl]++;
+}
+
+void Profiler::bytes( int messageType, int64 byteLength )
+{
+    if(messageType < 0 || messageType >= NUM_HANDLERS) return;
+    typeCount[messageType]++;
+    typeBytes[messageType] += byteLength;
+}
+
+void Profiler::nodeFinished( cSimpleModule *module )
+{
+    if(--liveNodes > 0) return;
+    char name[128];
+    EV << "Perfil de la red:" << endl;
+    for(int h=0; h<NUM_HANDLERS; h++){
+        if(calls[h] == 0) continue;
+        double perCall = (double)nanos[h] / calls[h];
+        EV << "  " << handlerName(h) << ": " << calls[h] << " llamadas, "
+           << nanos[h] / 1e6 << " ms, " << perCall << " ns/llamada" << endl;
+        sprintf(name, "perfil: %s llamadas", handlerName(h));
+        module->recordScalar(name, calls[h]);
+        sprintf(name, "perfil: %s tiempo (s)", handlerName(h));
+        module->recordScalar(name, nanos[h] / 1e9);
+    }
+    for(int d=0; d<=MAX_DEGREE; d++){
+        if(degreeCalls[d] == 0) continue;
+        sprintf(name, "perfil: grado %d%s ns/llamada", d, d == MAX_DEGREE? "+" : "");
+        module->recordScalar(name, (double)degreeNanos[d] / degreeCalls[d]);
+        sprintf(name, "perfil: grado %d%s llamadas", d, d == MAX_DEGREE? "+" : "");
+        module->recordScalar(name, degreeCalls[d]);
+    }
+    for(int c=0; c<=MAX_FANOUT; c++){
+        if(fanoutHist[c] == 0) continue;
+        sprintf(name, "perfil: fan-out %d%s", c, c == MAX_FANOUT? "+" : "");
+        module->recordScalar(name, fanoutHist[c]);
+    }
+    for(int t=0; t<=MAX_TTL; t++){
+        if(ttlHist[t] == 0) continue;
+        sprintf(name, "perfil: descartes con ttl %d%s", t, t == MAX_TTL? "+" : "");
+        module->recordScalar(name, ttlHist[t]);
+    }
+    for(int m=1; m<=FILE_ACK; m++){
+        if(typeCount[m] == 0) continue;
+        sprintf(name, "perfil: %s mensajes", handlerName(m));
+        module->recordScalar(name, typeCount[m]);
+        sprintf(name, "perfil: %s bytes", handlerName(m));
+        module->recordScalar(name, typeBytes[m]);
+    }
+}
+
+#endif
@@ -0,0 +1,125 @@
+//
+// Copyright (c) 2013 Daniel Iñigo, Efren Suarez, Yuriy Batrakov, José Sklatz
+//
+// Permission is hereby granted, free of charge, to any
+// person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the
+// Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the
+// Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice
+// shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+// KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+// PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+// OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+//
+// file: Profiler.h
+// author: Daniel Iñigo
+//
+
+#ifndef __PROFILER_H_
+#define __PROFILER_H_
+
+//
+// Instrumentación de los manejadores de NoFreeNode: llamadas y tiempo por
+// manejador y por grado del nodo, histograma de copias enviadas por mensaje
+// recibido (fan-out), TTL que les quedaba a los mensajes descartados (0 los
+// que lo agotaron; los duplicados y las respuestas sin camino de vuelta con
+// el que traían) y bytes por tipo de mensaje en dataGate. Al acabar, el último nodo en ejecutar
+// finish() graba el resumen de toda la red como escalares "perfil: ...".
+//
+// Sólo se compila si se define NOFREE_PROFILE (p.ej. opp_makemake ...
+// -DNOFREE_PROFILE); si no, las macros PROFILE_* no generan código.
+//
+
+#ifdef NOFREE_PROFILE
+
+#include <vector>
+#include <omnetpp.h>
+using namespace std;
+
+/**
+ * Acumuladores de la instrumentación, compartidos por todos los nodos del
+ * proceso (en simulación paralela, los de cada partición).
+ */
+class Profiler
+{
+public:
+    /**
+     * Manejador que se mide: el tipo de mensaje, TIMER para los automensajes
+     * o DISPATCH para handleMessage entero (incluye el manejador al que llama).
+     */
+    enum { TIMER = 0, DISPATCH = 8, NUM_HANDLERS = 9 };
+    /** Límites de los histogramas (el último cajón recoge el resto). */
+    enum { MAX_DEGREE = 64, MAX_FANOUT = 64, MAX_TTL = 32 };
+
+    /** Un nodo más en la red; el primero pone a cero los acumuladores. */
+    static void nodeStarted ( );
+    /** Un nodo ha terminado; el último graba el resumen en su módulo. */
+    static void nodeFinished ( cSimpleModule *module );
+
+    static void handlerCall ( int handler, int degree, int64 nanoseconds );
+    static void fanout ( int copies );
+    static void ttlDrop ( int ttl );
+    static void bytes ( int messageType, int64 byteLength );
+
+    /** Tiempo de CPU del hilo en nanosegundos. */
+    static int64 now ( );
+
+private:
+    static int liveNodes;
+    static long calls[NUM_HANDLERS];
+    static int64 nanos[NUM_HANDLERS];
+    static long degreeCalls[MAX_DEGREE+1];
+    static int64 degreeNanos[MAX_DEGREE+1];
+    static long fanoutHist[MAX_FANOUT+1];
+    static long ttlHist[MAX_TTL+1];
+    static long typeCount[NUM_HANDLERS];
+    static int64 typeBytes[NUM_HANDLERS];
+};
+
+/**
+ * Mide el tiempo desde que se crea hasta que se destruye (ámbito del manejador).
+ */
+class ProfileScope
+{
+public:
+    ProfileScope(int h, int d) : handler(h), degree(d), start(Profiler::now()) { }
+    ~ProfileScope() { Profiler::handlerCall(handler, degree, Profiler::now() - start); }
+private:
+    int handler;
+    int degree;
+    int64 start;
+};
+
+#define PROFILE_SCOPE(handler)      ProfileScope profileScope_(handler, neighbors.size())
+#define PROFILE_FANOUT(copies)      Profiler::fanout(copies)
+#define PROFILE_TTL_DROP(ttl)       Profiler::ttlDrop(ttl)
+#define PROFILE_BYTES(type, length) Profiler::bytes(type, length)
+#define PROFILE_NODE_STARTED()      Profiler::nodeStarted()
+#define PROFILE_NODE_FINISHED()     Profiler::nodeFinished(this)
+
+#else
+
+#define PROFILE_SCOPE(handler)
+#define PROFILE_FANOUT(copies)
+#define PROFILE_TTL_DROP(ttl)
+#define PROFILE_BYTES(type, length)
+#define PROFILE_NODE_STARTED()
+#define PROFILE_NODE_FINISHED()
+
+#endif
+
+#endif
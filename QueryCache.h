@@ -0,0 +1,123 @@
+//
+// Copyright (c) 2013 Daniel Iñigo, Efren Suarez, Yuriy Batrakov, José Sklatz
+//
+// Permission is hereby granted, free of charge, to any
+// person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the
+// Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the
+// Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice
+// shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+// KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+// PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+// OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+//
+// file: QueryCache.h
+// author: Daniel Iñigo
+//
+
+#ifndef __QUERYCACHE_H_
+#define __QUERYCACHE_H_
+
+#include <map>
+#include <deque>
+#include <omnetpp.h>
+using namespace std;
+
+/**
+ * Construye el identificador único de una consulta a partir del nodo que la
+ * originó y de su número de secuencia en ese nodo.
+ */
+inline int64 makeQueryId(int originNodeId, unsigned int querySeq)
+{
+    return ((int64)originNodeId << 32) | (int64)querySeq;
+}
+
+/**
+ * Caché acotada de identificadores de consulta que caducan pasado un tiempo.
+ * Cada entrada guarda además un valor entero (p.ej. la puerta por la que
+ * llegó la consulta). Como todas las entradas viven lo mismo, la cola de
+ * inserción está ordenada por caducidad y basta con mirar su cabeza.
+ */
+class QueryCache
+{
+public:
+    QueryCache() : capacity(0), timeout(0) { }
+
+    /** Fija el tamaño máximo y el tiempo de vida de las entradas. */
+    void configure(unsigned int capacity, simtime_t timeout) {
+        this->capacity = capacity;
+        this->timeout  = timeout;
+        clear();
+    }
+
+    /**
+     * Inserta la consulta si no estaba ya. Devuelve false si ya se había
+     * visto (y aún no ha caducado), en cuyo caso no se modifica nada.
+     */
+    bool insert(int64 queryId, int value, simtime_t now) {
+        expire(now);
+        if(entries.find(queryId) != entries.end()) return false;
+        // Si está llena se desaloja la más antigua.
+        if(capacity > 0 && entries.size() >= capacity){
+            entries.erase(order.front().queryId);
+            order.pop_front();
+        }
+        entries[queryId] = value;
+        order.push_back(Entry(queryId, now + timeout));
+        return true;
+    }
+
+    /** Busca la consulta; si está y no ha caducado devuelve su valor. */
+    bool lookup(int64 queryId, simtime_t now, int &value) {
+        expire(now);
+        map<int64, int>::const_iterator it = entries.find(queryId);
+        if(it == entries.end()) return false;
+        value = it->second;
+        return true;
+    }
+
+    /** Vacía la caché. */
+    void clear() {
+        entries.clear();
+        order.clear();
+    }
+
+    /** Número de entradas vivas. */
+    unsigned int size() const { return entries.size(); }
+
+private:
+    struct Entry {
+        int64 queryId;
+        simtime_t expiry;
+        Entry(int64 q, simtime_t e) : queryId(q), expiry(e) { }
+    };
+
+    /** Elimina las entradas que han caducado. */
+    void expire(simtime_t now) {
+        while(!order.empty() && order.front().expiry <= now){
+            entries.erase(order.front().queryId);
+            order.pop_front();
+        }
+    }
+
+    unsigned int capacity;          // Máximo de entradas (0 = sin límite).
+    simtime_t timeout;              // Tiempo de vida de cada entrada.
+    map<int64, int> entries;        // Consultas vistas y su valor asociado.
+    deque<Entry> order;             // Orden de inserción (y de caducidad).
+};
+
+#endif
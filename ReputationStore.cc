@@ -0,0 +1,183 @@
+//
+// Copyright (c) 2013 Daniel Iñigo, Efren Suarez, Yuriy Batrakov, José Sklatz
+//
+// Permission is hereby granted, free of charge, to any
+// person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the
+// Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the
+// Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice
+// shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+// KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+// PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+// OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+//
+// file: ReputationStore.cc
+// author: Daniel Iñigo
+//
+
+#include <string.h>
+#include <omnetpp.h>
+
+#include "ReputationStore.h"
+
+using namespace std;
+
+ReputationStore *ReputationStore::create(const char *type)
+{
+    if(strcmp(type, "map") == 0)   return new MapReputationStore();
+    if(strcmp(type, "hash") == 0)  return new HashReputationStore();
+    if(strcmp(type, "dense") == 0) return new DenseReputationStore();
+    throw cRuntimeError("Tipo de reputationStore desconocido: \"%s\" (map, hash o dense)", type);
+}
+
+/**
+ * Operador salida estandar para poder usar el WATCH() sobre el almacén.
+ */
+ostream& operator<<(ostream& os, const ReputationStore& store)
+{
+    vector< pair<int, PeerReputation> > entries;
+    store.collect(entries);
+    os << entries.size() << " nodos:";
+    for(unsigned int i=0; i<entries.size(); i++){
+        os << " " << entries[i].first << "=" << entries[i].second;
+    }
+    return os;
+}
+
+/////////// MAP ///////////
+
+PeerReputation *MapReputationStore::find(int peerId)
+{
+    map<int, PeerReputation>::iterator it = entries.find(peerId);
+    return (it != entries.end())? &it->second : NULL;
+}
+
+PeerReputation &MapReputationStore::get(int peerId)
+{
+    return entries[peerId];
+}
+
+size_t MapReputationStore::memoryUsage() const
+{
+    // Cada nodo del árbol lleva la pareja más tres punteros y el color.
+    return sizeof(*this) + entries.size() * (sizeof(pair<const int, PeerReputation>) + 4*sizeof(void *));
+}
+
+void MapReputationStore::collect(vector< pair<int, PeerReputation> > &out) const
+{
+    out.clear();
+    out.reserve(entries.size());
+    for(map<int, PeerReputation>::const_iterator it = entries.begin(); it != entries.end(); ++it){
+        out.push_back(*it);
+    }
+}
+
+/////////// HASH ///////////
+
+HashReputationStore::HashReputationStore() : slots(16), used(0) { }
+
+unsigned int HashReputationStore::probe(int peerId) const
+{
+    // Hash multiplicativo de Fibonacci, los ids de módulo son consecutivos.
+    unsigned int mask = slots.size() - 1;
+    unsigned int i = ((unsigned int)peerId * 2654435769u) & mask;
+    while(slots[i].peerId != EMPTY && slots[i].peerId != peerId){
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+void HashReputationStore::grow()
+{
+    vector<Slot> old;
+    old.swap(slots);
+    slots.resize(old.size() * 2);
+    for(unsigned int i=0; i<old.size(); i++){
+        if(old[i].peerId != EMPTY) slots[probe(old[i].peerId)] = old[i];
+    }
+}
+
+PeerReputation *HashReputationStore::find(int peerId)
+{
+    Slot &s = slots[probe(peerId)];
+    return (s.peerId == peerId)? &s.rep : NULL;
+}
+
+PeerReputation &HashReputationStore::get(int peerId)
+{
+    unsigned int i = probe(peerId);
+    if(slots[i].peerId == peerId) return slots[i].rep;
+    // No estaba: si se pasa de la mitad de ocupación se agranda antes de insertar.
+    if(2 * (used + 1) > slots.size()){
+        grow();
+        i = probe(peerId);
+    }
+    slots[i].peerId = peerId;
+    slots[i].rep = PeerReputation();
+    used++;
+    return slots[i].rep;
+}
+
+size_t HashReputationStore::memoryUsage() const
+{
+    return sizeof(*this) + slots.capacity() * sizeof(Slot);
+}
+
+void HashReputationStore::collect(vector< pair<int, PeerReputation> > &out) const
+{
+    out.clear();
+    out.reserve(used);
+    for(unsigned int i=0; i<slots.size(); i++){
+        if(slots[i].peerId != EMPTY) out.push_back(make_pair(slots[i].peerId, slots[i].rep));
+    }
+}
+
+/////////// DENSE ///////////
+
+PeerReputation *DenseReputationStore::find(int peerId)
+{
+    if(peerId < 0 || peerId >= (int)entries.size()) return NULL;
+    PeerReputation &p = entries[peerId];
+    return (p.totalRequest >= 0)? &p : NULL;
+}
+
+PeerReputation &DenseReputationStore::get(int peerId)
+{
+    if(peerId >= (int)entries.size()){
+        entries.resize(peerId + 1, PeerReputation(0, -1));
+    }
+    PeerReputation &p = entries[peerId];
+    if(p.totalRequest < 0){
+        p = PeerReputation();
+        used++;
+    }
+    return p;
+}
+
+size_t DenseReputationStore::memoryUsage() const
+{
+    return sizeof(*this) + entries.capacity() * sizeof(PeerReputation);
+}
+
+void DenseReputationStore::collect(vector< pair<int, PeerReputation> > &out) const
+{
+    out.clear();
+    out.reserve(used);
+    for(unsigned int i=0; i<entries.size(); i++){
+        if(entries[i].totalRequest >= 0) out.push_back(make_pair((int)i, entries[i]));
+    }
+}
@@ -0,0 +1,160 @@
+//
+// Copyright (c) 2013 Daniel Iñigo, Efren Suarez, Yuriy Batrakov, José Sklatz
+//
+// Permission is hereby granted, free of charge, to any
+// person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the
+// Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the
+// Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice
+// shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+// KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+// PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+// OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+//
+// file: ReputationStore.h
+// author: Daniel Iñigo
+//
+
+#ifndef __REPUTATIONSTORE_H_
+#define __REPUTATIONSTORE_H_
+
+#include <map>
+#include <vector>
+#include <iostream>
+#include <omnetpp.h>
+using namespace std;
+
+/**
+ * Clase muy básica para almacenar la reputación
+ */
+struct PeerReputation {
+    int acceptedRequest;    // Peticiones aceptadas.
+    int totalRequest;       // Peticiones aceptadas.
+    /** Constructor por defecto */
+    PeerReputation() {acceptedRequest=0; totalRequest=0;}
+    /** Constructor con parámetros */
+    PeerReputation(int a, int t) {acceptedRequest=a; totalRequest=t;}
+};
+
+ostream& operator<<(ostream& os, const PeerReputation& p);
+istream& operator>>(istream& is, PeerReputation& p);
+
+/**
+ * Almacén de la reputación que un nodo tiene de los demás, indexado por el
+ * id de módulo del nodo. Hay varias implementaciones intercambiables para
+ * poder comparar memoria y velocidad; se elige con el parámetro
+ * "reputationStore" del NoFreeNode.
+ *
+ * Los punteros y referencias que se devuelven sólo son válidos hasta la
+ * siguiente llamada a get() (puede reubicar las entradas).
+ */
+class ReputationStore
+{
+public:
+    virtual ~ReputationStore() { }
+
+    /**
+     * Crea el almacén del tipo dado: "map" (std::map), "hash" (tabla hash
+     * de direccionamiento abierto) o "dense" (array indexado por id).
+     */
+    static ReputationStore *create(const char *type);
+
+    /** Devuelve la reputación del nodo o NULL si no se tiene. */
+    virtual PeerReputation *find(int peerId) = 0;
+
+    /** Devuelve la reputación del nodo, creándola vacía si no se tenía. */
+    virtual PeerReputation &get(int peerId) = 0;
+
+    /** Número de nodos de los que se tiene reputación. */
+    virtual unsigned int size() const = 0;
+
+    /** Memoria aproximada que ocupa el almacén en bytes. */
+    virtual size_t memoryUsage() const = 0;
+
+    /** Copia todas las entradas (id, reputación) en el vector dado. */
+    virtual void collect(vector< pair<int, PeerReputation> > &out) const = 0;
+};
+
+ostream& operator<<(ostream& os, const ReputationStore& store);
+
+/**
+ * Implementación original sobre std::map: un nodo del árbol por entrada.
+ */
+class MapReputationStore : public ReputationStore
+{
+public:
+    virtual PeerReputation *find(int peerId);
+    virtual PeerReputation &get(int peerId);
+    virtual unsigned int size() const { return entries.size(); }
+    virtual size_t memoryUsage() const;
+    virtual void collect(vector< pair<int, PeerReputation> > &out) const;
+
+private:
+    map<int, PeerReputation> entries;
+};
+
+/**
+ * Tabla hash plana de direccionamiento abierto (sondeo lineal) con las
+ * entradas contiguas en memoria. Crece al superar la mitad de ocupación.
+ */
+class HashReputationStore : public ReputationStore
+{
+public:
+    HashReputationStore();
+    virtual PeerReputation *find(int peerId);
+    virtual PeerReputation &get(int peerId);
+    virtual unsigned int size() const { return used; }
+    virtual size_t memoryUsage() const;
+    virtual void collect(vector< pair<int, PeerReputation> > &out) const;
+
+private:
+    struct Slot {
+        int peerId;             // EMPTY si la casilla está libre.
+        PeerReputation rep;
+        Slot() : peerId(EMPTY) { }
+    };
+    static const int EMPTY = -1;
+
+    /** Casilla donde está (o debería estar) el nodo. */
+    unsigned int probe(int peerId) const;
+    /** Duplica la tabla y recoloca las entradas. */
+    void grow();
+
+    vector<Slot> slots;         // Tamaño siempre potencia de 2.
+    unsigned int used;          // Casillas ocupadas.
+};
+
+/**
+ * Array denso indexado directamente por id de módulo: una única indirección
+ * por acceso a cambio de reservar hasta el mayor id visto.
+ */
+class DenseReputationStore : public ReputationStore
+{
+public:
+    DenseReputationStore() : used(0) { }
+    virtual PeerReputation *find(int peerId);
+    virtual PeerReputation &get(int peerId);
+    virtual unsigned int size() const { return used; }
+    virtual size_t memoryUsage() const;
+    virtual void collect(vector< pair<int, PeerReputation> > &out) const;
+
+private:
+    vector<PeerReputation> entries;     // totalRequest < 0 marca hueco vacío.
+    unsigned int used;                  // Entradas ocupadas.
+};
+
+#endif
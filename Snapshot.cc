@@ -0,0 +1,247 @@
+//
+// Copyright (c) 2013 Daniel Iñigo, Efren Suarez, Yuriy Batrakov, José Sklatz
+//
+// Permission is hereby granted, free of charge, to any
+// person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the
+// Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the
+// Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice
+// shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+// KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+// PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+// OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+//
+// file: Snapshot.cc
+// author: Daniel Iñigo
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <omnetpp.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "Snapshot.h"
+
+Register_PerRunConfigOption(CFGID_NOFREE_SNAPSHOT_SAVE, "nofree-snapshot-save", CFG_FILENAME, "",
+        "Fichero en el que guardar la instantánea de reputación de la red (vacío = no se guarda).");
+Register_PerRunConfigOptionU(CFGID_NOFREE_SNAPSHOT_TIME, "nofree-snapshot-time", "s", "0s",
+        "Instante de simulación en el que se guarda la instantánea.");
+Register_PerRunConfigOption(CFGID_NOFREE_SNAPSHOT_LOAD, "nofree-snapshot-load", CFG_FILENAME, "",
+        "Instantánea desde la que restaurar la reputación de los nodos al inicializar (vacío = no se restaura).");
+
+int Snapshot::expected = 0;
+simtime_t Snapshot::savedAt;
+vector<Snapshot::NodeIndex> Snapshot::savedNodes;
+vector<Snapshot::Entry> Snapshot::savedEntries;
+string Snapshot::mappedFile;
+const char *Snapshot::data = NULL;
+size_t Snapshot::dataSize = 0;
+int Snapshot::users = 0;
+
+/** Para ordenar y buscar el índice por id de nodo. */
+struct NodeIdLess {
+    template<class A, class B> bool operator()(const A &a, const B &b) const { return id(a) < id(b); }
+    template<class T> static int id(const T &n) { return n.nodeId; }
+    static int id(int n) { return n; }
+};
+
+string Snapshot::saveFile()
+{
+    return ev.getConfig()->getAsFilename(CFGID_NOFREE_SNAPSHOT_SAVE);
+}
+
+simtime_t Snapshot::saveTime()
+{
+    return ev.getConfig()->getAsDouble(CFGID_NOFREE_SNAPSHOT_TIME);
+}
+
+string Snapshot::loadFile()
+{
+    return ev.getConfig()->getAsFilename(CFGID_NOFREE_SNAPSHOT_LOAD);
+}
+
+void Snapshot::expectNode()
+{
+    expected++;
+}
+
+void Snapshot::cancelNode()
+{
+    // Si ya no queda nadie por guardar se tira lo que hubiera a medias.
+    if(--expected > 0) return;
+    savedNodes.clear();
+    savedEntries.clear();
+}
+
+void Snapshot::saveNode( int nodeId, bool freerider, const ReputationStore &store )
+{
+    vector< pair<int, PeerReputation> > entries;
+    store.collect(entries);
+    NodeIndex node;
+    node.nodeId     = nodeId;
+    node.flags      = freerider? FREERIDER : 0;
+    node.numEntries = entries.size();
+    node.reserved   = 0;
+    node.offset     = savedEntries.size();  // De momento nº de entrada; al escribir, bytes.
+    savedNodes.push_back(node);
+    for(unsigned int i=0; i<entries.size(); i++){
+        Entry e;
+        e.peerId          = entries[i].first;
+        e.acceptedRequest = entries[i].second.acceptedRequest;
+        e.totalRequest    = entries[i].second.totalRequest;
+        savedEntries.push_back(e);
+    }
+    savedAt = simTime();
+    if(--expected == 0) write();
+}
+
+void Snapshot::write()
+{
+    string file = saveFile();
+    Header header;
+    memcpy(header.magic, "NOFREESN", sizeof(header.magic));
+    header.version  = VERSION;
+    header.numNodes = savedNodes.size();
+    header.numRngs  = ev.getNumRNGs();
+    header.reserved = 0;
+    header.simTime  = SIMTIME_DBL(savedAt);
+    vector<uint64> rngs(header.numRngs);
+    for(unsigned int k=0; k<header.numRngs; k++) rngs[k] = ev.getRNG(k)->getNumbersDrawn();
+    // El índice va ordenado por id para buscar con búsqueda binaria.
+    sort(savedNodes.begin(), savedNodes.end(), NodeIdLess());
+    uint64 base = sizeof(Header) + rngs.size()*sizeof(uint64) + savedNodes.size()*sizeof(NodeIndex);
+    for(unsigned int i=0; i<savedNodes.size(); i++){
+        savedNodes[i].offset = base + savedNodes[i].offset*sizeof(Entry);
+    }
+
+    FILE *f = fopen(file.c_str(), "wb");
+    if(f == NULL) throw cRuntimeError("No se puede crear la instantánea '%s'", file.c_str());
+    bool ok = fwrite(&header, sizeof(Header), 1, f) == 1;
+    if(!rngs.empty())         ok = ok && fwrite(&rngs[0], sizeof(uint64), rngs.size(), f) == rngs.size();
+    if(!savedNodes.empty())   ok = ok && fwrite(&savedNodes[0], sizeof(NodeIndex), savedNodes.size(), f) == savedNodes.size();
+    if(!savedEntries.empty()) ok = ok && fwrite(&savedEntries[0], sizeof(Entry), savedEntries.size(), f) == savedEntries.size();
+    ok = (fclose(f) == 0) && ok;
+    if(!ok) throw cRuntimeError("Error al escribir la instantánea '%s'", file.c_str());
+    EV << "Instantánea de " << savedNodes.size() << " nodos y " << savedEntries.size()
+       << " reputaciones guardada en " << file << " (t=" << savedAt << ")" << endl;
+    savedNodes.clear();
+    savedEntries.clear();
+}
+
+void Snapshot::acquire( const string &file )
+{
+    if(data != NULL && file == mappedFile){
+        users++;
+        return;
+    }
+    if(data != NULL) throw cRuntimeError("Ya hay otra instantánea cargada ('%s')", mappedFile.c_str());
+#ifndef _WIN32
+    int fd = open(file.c_str(), O_RDONLY);
+    if(fd < 0) throw cRuntimeError("No se puede abrir la instantánea '%s'", file.c_str());
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(Header)){
+        close(fd);
+        throw cRuntimeError("'%s' no es una instantánea", file.c_str());
+    }
+    dataSize = st.st_size;
+    void *p = mmap(NULL, dataSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(p == MAP_FAILED) throw cRuntimeError("No se puede mapear la instantánea '%s'", file.c_str());
+    data = (const char *)p;
+#else
+    // Sin mmap se lee entero.
+    FILE *f = fopen(file.c_str(), "rb");
+    if(f == NULL) throw cRuntimeError("No se puede abrir la instantánea '%s'", file.c_str());
+    fseek(f, 0, SEEK_END);
+    dataSize = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *buffer = (char *)malloc(dataSize);
+    bool ok = buffer != NULL && fread(buffer, 1, dataSize, f) == dataSize;
+    fclose(f);
+    if(!ok){
+        free(buffer);
+        throw cRuntimeError("No se puede leer la instantánea '%s'", file.c_str());
+    }
+    data = buffer;
+#endif
+    mappedFile = file;
+    users = 1;
+
+    const Header *header = (const Header *)data;
+    uint64 indexEnd = sizeof(Header) + (uint64)header->numRngs*sizeof(uint64) + (uint64)header->numNodes*sizeof(NodeIndex);
+    if(dataSize < sizeof(Header) || memcmp(header->magic, "NOFREESN", sizeof(header->magic)) != 0
+            || header->version != VERSION || indexEnd > dataSize){
+        unmap();
+        throw cRuntimeError("'%s' no es una instantánea válida", file.c_str());
+    }
+    // Los generadores vuelven a la posición que tenían al tomarla. Sólo se
+    // puede avanzar: si ya se han sacado más números (la construcción de la
+    // red no es la misma) no se puede seguir por donde iban.
+    const uint64 *rngs = (const uint64 *)(data + sizeof(Header));
+    for(int k=0; k<(int)header->numRngs && k<ev.getNumRNGs(); k++){
+        cRNG *rng = ev.getRNG(k);
+        if(rng->getNumbersDrawn() > rngs[k]){
+            unmap();
+            throw cRuntimeError("El generador %d ya ha sacado más números que en la instantánea '%s'", k, file.c_str());
+        }
+        while(rng->getNumbersDrawn() < rngs[k]) rng->intRand();
+    }
+    EV << "Instantánea " << file << ": " << header->numNodes << " nodos (t=" << header->simTime << ")" << endl;
+}
+
+bool Snapshot::restoreNode( int nodeId, bool &freerider, ReputationStore &store )
+{
+    const Header *header = (const Header *)data;
+    const NodeIndex *index = (const NodeIndex *)(data + sizeof(Header) + header->numRngs*sizeof(uint64));
+    const NodeIndex *end = index + header->numNodes;
+    const NodeIndex *node = lower_bound(index, end, nodeId, NodeIdLess());
+    if(node == end || node->nodeId != nodeId) return false;
+    if(node->offset + (uint64)node->numEntries*sizeof(Entry) > dataSize){
+        throw cRuntimeError("Instantánea '%s' truncada en el nodo %d", mappedFile.c_str(), nodeId);
+    }
+    freerider = (node->flags & FREERIDER) != 0;
+    const Entry *entries = (const Entry *)(data + node->offset);
+    for(unsigned int i=0; i<node->numEntries; i++){
+        store.get(entries[i].peerId) = PeerReputation(entries[i].acceptedRequest, entries[i].totalRequest);
+    }
+    return true;
+}
+
+void Snapshot::release()
+{
+    if(data != NULL && --users == 0) unmap();
+}
+
+void Snapshot::unmap()
+{
+#ifndef _WIN32
+    munmap((void *)data, dataSize);
+#else
+    free((void *)data);
+#endif
+    data = NULL;
+    dataSize = 0;
+    users = 0;
+    mappedFile.clear();
+}
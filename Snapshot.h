@@ -0,0 +1,130 @@
+//
+// Copyright (c) 2013 Daniel Iñigo, Efren Suarez, Yuriy Batrakov, José Sklatz
+//
+// Permission is hereby granted, free of charge, to any
+// person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the
+// Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the
+// Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice
+// shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+// KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+// PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+// OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+//
+// file: Snapshot.h
+// author: Daniel Iñigo
+//
+
+#ifndef __SNAPSHOT_H_
+#define __SNAPSHOT_H_
+
+#include <string>
+#include <vector>
+#include <omnetpp.h>
+#include "ReputationStore.h"
+using namespace std;
+
+/**
+ * Instantánea binaria del estado de reputación de toda la red: la tabla de
+ * reputación y el flag de freerider de cada nodo y la posición (números
+ * sacados) de cada generador aleatorio. Permite arrancar una simulación
+ * desde un estado ya "envejecido" sin volver a simular el calentamiento.
+ *
+ * Se controla desde el ini:
+ *   nofree-snapshot-save = "fichero"   se escribe al llegar a nofree-snapshot-time
+ *   nofree-snapshot-load = "fichero"   se restaura en initialize() de cada nodo
+ *
+ * Formato (orden de bytes de la máquina): cabecera, posición de cada RNG,
+ * índice de nodos ordenado por id y, detrás, las entradas de reputación de
+ * cada nodo seguidas. La carga mapea el fichero en memoria y busca cada nodo
+ * en el índice, sin copiarlo entero.
+ *
+ * Los ids son ids de módulo, así que la instantánea sólo vale para la misma
+ * red. No es apta para simulación paralela (cada partición vería sólo sus
+ * nodos).
+ */
+class Snapshot
+{
+public:
+    /** Fichero donde guardar ("" si no se guarda) y cuándo. */
+    static string saveFile ( );
+    static simtime_t saveTime ( );
+    /** Fichero desde el que restaurar ("" si no se restaura). */
+    static string loadFile ( );
+
+    /** Un nodo más guardará su estado; el fichero se escribe con el último. */
+    static void expectNode ( );
+    /** Añade el estado de un nodo; si era el último que faltaba escribe el fichero. */
+    static void saveNode ( int nodeId, bool freerider, const ReputationStore &store );
+    /** Un nodo que esperaba guardar se destruye antes de hacerlo. */
+    static void cancelNode ( );
+
+    /**
+     * Mapea el fichero (sólo la primera vez) y restaura la posición de los
+     * generadores aleatorios, así que hay que llamarla antes de que ningún
+     * módulo saque números. Lanza cRuntimeError si no es una instantánea o
+     * si algún generador ya ha pasado de la posición guardada.
+     */
+    static void acquire ( const string &file );
+    /**
+     * Restaura el estado del nodo en store y freerider. Devuelve false si el
+     * nodo no está en la instantánea.
+     */
+    static bool restoreNode ( int nodeId, bool &freerider, ReputationStore &store );
+    /** Lo llama cada nodo que hizo acquire(); con el último se desmapea. */
+    static void release ( );
+
+private:
+    struct Header {
+        char magic[8];          // "NOFREESN"
+        uint32 version;
+        uint32 numNodes;
+        uint32 numRngs;
+        uint32 reserved;
+        double simTime;         // Instante en que se tomó.
+    };
+    struct NodeIndex {
+        int32 nodeId;
+        uint32 flags;           // FREERIDER.
+        uint32 numEntries;
+        uint32 reserved;
+        uint64 offset;          // Desde el principio del fichero.
+    };
+    struct Entry {
+        int32 peerId;
+        int32 acceptedRequest;
+        int32 totalRequest;
+    };
+    enum { VERSION = 1, FREERIDER = 1 };
+
+    static void write ( );
+    static void unmap ( );
+
+    // Guardado en curso.
+    static int expected;
+    static simtime_t savedAt;
+    static vector<NodeIndex> savedNodes;
+    static vector<Entry> savedEntries;
+
+    // Fichero mapeado.
+    static string mappedFile;
+    static const char *data;
+    static size_t dataSize;
+    static int users;
+};
+
+#endif
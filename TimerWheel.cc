@@ -0,0 +1,317 @@
+//
+// Copyright (c) 2013 Daniel Iñigo, Efren Suarez, Yuriy Batrakov, José Sklatz
+//
+// Permission is hereby granted, free of charge, to any
+// person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the
+// Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the
+// Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice
+// shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+// KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+// PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+// OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+//
+// file: TimerWheel.cc
+// author: Daniel Iñigo
+//
+
+#include <math.h>
+#include <algorithm>
+#include <omnetpp.h>
+
+#include "TimerWheel.h"
+
+Define_Module(TimerWheel);
+
+using namespace std;
+
+static const int64 MASK = TimerWheel::SLOTS - 1;
+
+/** Orden de due: el que vence más tarde delante (se dispara por el final). */
+static bool laterFirst(const WheelEntry *a, const WheelEntry *b)
+{
+    return a->when > b->when || (a->when == b->when && a->seq > b->seq);
+}
+
+WheelEntry::~WheelEntry()
+{
+    if(wheel != NULL) wheel->remove(this);
+}
+
+TimerWheel::TimerWheel()
+{
+    tickLength  = 0;
+    currentTick = 0;
+    drained     = false;
+    nextSeq     = 0;
+    heads.assign(OVERFLOW+1, (WheelEntry *)NULL);
+    countScheduled = countFired = countBatches = 0;
+    pending = maxPending = 0;
+    fireMsg = NULL;
+    firing  = false;
+}
+
+TimerWheel::~TimerWheel()
+{
+    // Los temporizadores que sigan colgados de sus mensajes ya no tienen rueda.
+    for(unsigned int l=0; l<heads.size(); l++){
+        for(WheelEntry *e = heads[l]; e != NULL; e = e->next){
+            e->wheel = NULL;
+            e->list = -1;
+        }
+    }
+    for(unsigned int i=0; i<due.size(); i++){
+        due[i]->wheel = NULL;
+        due[i]->list = -1;
+    }
+    cancelAndDelete(fireMsg);
+}
+
+TimerWheel *TimerWheel::get()
+{
+    return dynamic_cast<TimerWheel *>(simulation.getSystemModule()->getSubmodule("timerWheel"));
+}
+
+void TimerWheel::configure()
+{
+    // Los nodos pueden programar antes de que se inicialice la rueda.
+    if(tickLength <= 0) tickLength = par("tick");
+    if(tickLength <= 0) throw cRuntimeError("tick debe ser mayor que 0");
+}
+
+void TimerWheel::initialize()
+{
+    configure();
+    WATCH(pending);
+    WATCH(countFired);
+    WATCH(countBatches);
+}
+
+void TimerWheel::schedule( TimerClient *client, cMessage *timer, simtime_t when )
+{
+    // Con el contexto de la rueda el automensaje que se crea aquí es suyo.
+    Enter_Method_Silent();
+    configure();
+    if(fireMsg == NULL) fireMsg = new cMessage("timerWheel");
+    WheelEntry *e = dynamic_cast<WheelEntry *>(timer->getControlInfo());
+    if(e == NULL){
+        e = new WheelEntry();
+        e->timer = timer;
+        timer->setControlInfo(e);
+    }
+    else unlink(e);
+    e->wheel  = this;
+    e->client = client;
+    e->when   = when;
+    e->tick   = (int64)floor(SIMTIME_DBL(when) / tickLength);
+    e->seq    = nextSeq++;
+    pending++;
+    countScheduled++;
+    if(pending > maxPending) maxPending = pending;
+    place(e);
+    update();
+}
+
+void TimerWheel::cancel( cMessage *timer )
+{
+    Enter_Method_Silent();
+    WheelEntry *e = dynamic_cast<WheelEntry *>(timer->getControlInfo());
+    if(e == NULL || e->list < 0) return;
+    unlink(e);
+    update();
+}
+
+void TimerWheel::remove( WheelEntry *e )
+{
+    // Se llama al borrar el timer, desde el contexto del nodo.
+    Enter_Method_Silent();
+    if(e->list < 0) return;
+    unlink(e);
+    update();
+}
+
+bool TimerWheel::isScheduled( cMessage *timer ) const
+{
+    WheelEntry *e = dynamic_cast<WheelEntry *>(timer->getControlInfo());
+    return e != NULL && e->list >= 0;
+}
+
+void TimerWheel::unlink( WheelEntry *e )
+{
+    if(e->list == DUE){
+        due.erase(find(due.begin(), due.end(), e));
+    }
+    else if(e->list >= 0){
+        if(e->prev != NULL) e->prev->next = e->next;
+        else heads[e->list] = e->next;
+        if(e->next != NULL) e->next->prev = e->prev;
+    }
+    else return;
+    e->prev = e->next = NULL;
+    e->list = -1;
+    pending--;
+}
+
+void TimerWheel::push( int list, WheelEntry *e )
+{
+    e->prev = NULL;
+    e->next = heads[list];
+    if(e->next != NULL) e->next->prev = e;
+    heads[list] = e;
+    e->list = list;
+}
+
+void TimerWheel::insertDue( WheelEntry *e )
+{
+    due.insert(lower_bound(due.begin(), due.end(), e, laterFirst), e);
+    e->list = DUE;
+}
+
+void TimerWheel::place( WheelEntry *e )
+{
+    // Lo que vence en la casilla ya vaciada (o antes) va directo a due.
+    if(drained && e->tick <= currentTick){
+        insertDue(e);
+        return;
+    }
+    // Si no, al nivel más bajo cuyo tramo comparte con currentTick.
+    for(int l=0; l<LEVELS; l++){
+        int shift = BITS*(l+1);
+        if((e->tick >> shift) == (currentTick >> shift)){
+            push(l*SLOTS + (int)((e->tick >> (BITS*l)) & MASK), e);
+            return;
+        }
+    }
+    push(OVERFLOW, e);
+}
+
+void TimerWheel::cascade( int list )
+{
+    WheelEntry *e = heads[list];
+    heads[list] = NULL;
+    while(e != NULL){
+        WheelEntry *next = e->next;
+        e->prev = e->next = NULL;
+        e->list = -1;
+        place(e);
+        e = next;
+    }
+}
+
+int TimerWheel::scan( int level, int from ) const
+{
+    for(int s=from; s<SLOTS; s++){
+        if(heads[level*SLOTS + s] != NULL) return s;
+    }
+    return -1;
+}
+
+bool TimerWheel::advance()
+{
+    if(pending == 0) return false;
+    for(;;){
+        // Siguiente casilla no vacía del tramo actual del nivel 0.
+        int s = scan(0, (int)(currentTick & MASK) + (drained? 1 : 0));
+        if(s >= 0){
+            currentTick = (currentTick & ~MASK) | s;
+            drained = true;
+            WheelEntry *e = heads[s];
+            heads[s] = NULL;
+            while(e != NULL){
+                WheelEntry *next = e->next;
+                e->prev = e->next = NULL;
+                insertDue(e);
+                e = next;
+            }
+            return true;
+        }
+        // Si no hay, se baja la siguiente casilla ocupada de un nivel superior.
+        bool found = false;
+        for(int l=1; l<LEVELS && !found; l++){
+            s = scan(l, (int)((currentTick >> (BITS*l)) & MASK) + 1);
+            if(s >= 0){
+                int64 high = (currentTick >> (BITS*(l+1))) << (BITS*(l+1));
+                currentTick = high | ((int64)s << (BITS*l));
+                drained = false;
+                cascade(l*SLOTS + s);
+                found = true;
+            }
+        }
+        if(found) continue;
+        // Y si tampoco, se salta al primero de los lejanos y se recolocan.
+        if(heads[OVERFLOW] == NULL) return false;
+        int64 first = heads[OVERFLOW]->tick;
+        for(WheelEntry *e = heads[OVERFLOW]; e != NULL; e = e->next) first = min(first, e->tick);
+        currentTick = first;
+        drained = false;
+        cascade(OVERFLOW);
+    }
+}
+
+void TimerWheel::update()
+{
+    if(firing) return;
+    if(due.empty()) advance();
+    rearm();
+}
+
+void TimerWheel::rearm()
+{
+    if(fireMsg == NULL) return;
+    if(due.empty()){
+        if(fireMsg->isScheduled()) cancelEvent(fireMsg);
+        return;
+    }
+    simtime_t t = due.back()->when;
+    if(fireMsg->isScheduled()){
+        if(fireMsg->getArrivalTime() == t) return;
+        cancelEvent(fireMsg);
+    }
+    scheduleAt(t, fireMsg);
+}
+
+void TimerWheel::handleMessage( cMessage *msg )
+{
+    // Se disparan juntos todos los que vencen ahora, en orden de programación
+    // (los que se programen para ahora desde un aviso entran en el mismo lote).
+    simtime_t now = simTime();
+    long fired = 0;
+    firing = true;
+    while(!due.empty() && due.back()->when <= now){
+        WheelEntry *e = due.back();
+        due.pop_back();
+        e->list = -1;
+        pending--;
+        fired++;
+        e->client->wheelTimerFired(e->timer);
+    }
+    firing = false;
+    if(fired > 0){
+        countFired += fired;
+        countBatches++;
+    }
+    update();
+}
+
+void TimerWheel::finish()
+{
+    recordScalar("Temporizadores programados", countScheduled);
+    recordScalar("Temporizadores disparados", countFired);
+    recordScalar("Lotes disparados", countBatches);
+    recordScalar("Temporizadores por lote", countBatches? (double)countFired/countBatches : 0);
+    recordScalar("Maximo de temporizadores pendientes", maxPending);
+}
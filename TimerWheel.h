@@ -0,0 +1,152 @@
+//
+// Copyright (c) 2013 Daniel Iñigo, Efren Suarez, Yuriy Batrakov, José Sklatz
+//
+// Permission is hereby granted, free of charge, to any
+// person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the
+// Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the
+// Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice
+// shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+// KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+// PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+// OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+//
+// file: TimerWheel.h
+// author: Daniel Iñigo
+//
+
+#ifndef __TIMERWHEEL_H_
+#define __TIMERWHEEL_H_
+
+#include <vector>
+#include <omnetpp.h>
+using namespace std;
+
+class TimerWheel;
+
+/**
+ * Quien programa temporizadores en la rueda: recibe el aviso cuando vencen.
+ */
+class TimerClient
+{
+public:
+    virtual ~TimerClient() { }
+    /** Ha vencido el temporizador (equivale a recibirlo como automensaje). */
+    virtual void wheelTimerFired ( cMessage *timer ) = 0;
+};
+
+/**
+ * Temporizador de la rueda. Va colgado del cMessage como control info, así
+ * que si se borra el mensaje se desprograma solo.
+ */
+class WheelEntry : public cObject
+{
+public:
+    WheelEntry() : wheel(NULL), client(NULL), timer(NULL), tick(0), seq(0), prev(NULL), next(NULL), list(-1) { }
+    virtual ~WheelEntry();
+
+    TimerWheel *wheel;
+    TimerClient *client;
+    cMessage *timer;
+    simtime_t when;             // Instante exacto en que vence.
+    int64 tick;                 // when / tick de la rueda.
+    uint64 seq;                 // Orden de programación (desempata como la FES).
+    WheelEntry *prev, *next;    // Lista de la casilla.
+    int list;                   // Casilla en la que está, DUE o -1 si no está programado.
+};
+
+/**
+ * Planificador único para los temporizadores de todos los nodos: una rueda
+ * jerárquica de LEVELS niveles de SLOTS casillas (el nivel l cubre ticks de
+ * SLOTS^l) más una lista para lo que cae más lejos. En la FES sólo hay un
+ * automensaje, en el vencimiento más próximo, y en ese evento se disparan
+ * todos los temporizadores que vencen en el mismo instante, en el orden en
+ * que se programaron.
+ *
+ * Los temporizadores vencen en su instante exacto: el tick sólo fija el
+ * ancho de las casillas (cuántos se ordenan juntos al vaciar una). Lo que
+ * cambia respecto a scheduleAt es el orden frente a los demás eventos del
+ * mismo instante (mensajes de los enlaces, automensajes de otros módulos):
+ * todos los temporizadores de ese instante van juntos en el evento de la
+ * rueda, que está en la FES desde que se programó el primero de ellos o se
+ * volvió a armar la rueda, así que pueden dispararse antes o después de
+ * eventos que sin rueda irían entre ellos.
+ *
+ * Es el submódulo "timerWheel" de la red (se pone con useTimerWheel = true).
+ * Llama directamente a los nodos, así que no vale en simulación paralela.
+ */
+class TimerWheel : public cSimpleModule
+{
+public:
+    enum { BITS = 8, SLOTS = 1 << BITS, LEVELS = 4, OVERFLOW = LEVELS*SLOTS, DUE = OVERFLOW+1 };
+
+    TimerWheel ( );
+    virtual ~TimerWheel ( );
+
+    /** Devuelve la rueda de la red o NULL si la red no la tiene. */
+    static TimerWheel *get ( );
+
+    /** Programa (o reprograma) el temporizador para que venza en when. */
+    void schedule ( TimerClient *client, cMessage *timer, simtime_t when );
+    /** Desprograma el temporizador si estaba programado. */
+    void cancel ( cMessage *timer );
+    /** Si el temporizador está programado en la rueda. */
+    bool isScheduled ( cMessage *timer ) const;
+
+    /** Se destruye la entrada: se saca y se vuelve a armar la rueda. */
+    void remove ( WheelEntry *e );
+
+protected:
+    double tickLength;              // Resolución de las casillas en segundos.
+    int64 currentTick;              // Tick de la última casilla vaciada en "due".
+    bool drained;                   // Si la casilla de currentTick ya se vació.
+    uint64 nextSeq;
+    vector<WheelEntry *> heads;     // Cabeza de cada casilla (y de OVERFLOW).
+    vector<WheelEntry *> due;       // Listos para disparar, de más tarde a más pronto.
+    cMessage *fireMsg;              // El único automensaje de la rueda (se crea al programar el primero).
+    bool firing;                    // Si se están disparando (se arma al acabar).
+
+    long countScheduled;
+    long countFired;
+    long countBatches;
+    long pending;                   // Temporizadores programados ahora.
+    long maxPending;
+
+    virtual void initialize ( );
+    virtual void handleMessage ( cMessage *msg );
+    virtual void finish ( );
+
+    void configure ( );
+    /** Saca la entrada de la lista en la que esté. */
+    void unlink ( WheelEntry *e );
+    /** Coloca la entrada en su casilla según currentTick (o en due si ya toca). */
+    void place ( WheelEntry *e );
+    void push ( int list, WheelEntry *e );
+    void insertDue ( WheelEntry *e );
+    /** Busca la siguiente casilla con temporizadores y la vuelca en due. */
+    bool advance ( );
+    /** Recoloca lo que hay en una casilla (al bajar de nivel). */
+    void cascade ( int list );
+    /** Primera casilla no vacía del nivel a partir de from, o -1. */
+    int scan ( int level, int from ) const;
+    /** Busca el siguiente lote si hace falta y arma el automensaje (salvo mientras se dispara). */
+    void update ( );
+    /** Programa el automensaje en el vencimiento más próximo. */
+    void rearm ( );
+};
+
+#endif
@@ -0,0 +1,360 @@
+//
+// Copyright (c) 2013 Daniel Iñigo, Efren Suarez, Yuriy Batrakov, José Sklatz
+//
+// Permission is hereby granted, free of charge, to any
+// person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the
+// Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the
+// Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice
+// shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+// KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+// PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+// OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+//
+// file: TrustAnalyzer.cc
+// author: Daniel Iñigo
+//
+
+#include <math.h>
+#include <time.h>
+#include <algorithm>
+#include <omnetpp.h>
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#include "TrustAnalyzer.h"
+#include "NoFreeNode.h"
+
+Define_Module(TrustAnalyzer);
+
+using namespace std;
+
+/** Trozo de filas de un producto C^T x que hace un hilo. */
+struct MultiplyTask {
+    const TrustAnalyzer *analyzer;
+    struct WorkerPool *pool;
+    int begin, end;
+    const vector<double> *x;
+    double base;
+    vector<double> *y;
+    double diff;
+};
+
+/**
+ * Hilos que viven lo que el módulo y hacen cada producto entre dos esperas
+ * en una barrera (una para empezar y otra para terminar), en vez de crear
+ * y juntar hilos en cada iteración.
+ */
+struct WorkerPool {
+#ifndef _WIN32
+    pthread_mutex_t startLock;      // Retiene a los hilos hasta que existe la barrera.
+    pthread_barrier_t barrier;      // Hilos del pool más el principal.
+    vector<pthread_t> ids;
+#endif
+    vector<MultiplyTask> tasks;     // Trozo de cada hilo; el 0 lo hace el principal.
+    int workers;                    // Hilos que se pudieron crear (hacen los trozos 1..workers).
+    bool stop;
+    WorkerPool() : workers(0), stop(false) { }
+};
+
+/** Segundos de reloj (no de CPU, que con varios hilos se suma). */
+static double wallSeconds()
+{
+#ifndef _WIN32
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+static void *multiplyThread(void *arg)
+{
+    MultiplyTask *task = (MultiplyTask *)arg;
+    task->diff = task->analyzer->multiply(task->begin, task->end, *task->x, task->base, *task->y);
+    return NULL;
+}
+
+#ifndef _WIN32
+static void *poolThread(void *arg)
+{
+    MultiplyTask *task = (MultiplyTask *)arg;
+    WorkerPool *pool = task->pool;
+    pthread_mutex_lock(&pool->startLock);
+    pthread_mutex_unlock(&pool->startLock);
+    while(true){
+        pthread_barrier_wait(&pool->barrier);
+        if(pool->stop) break;
+        multiplyThread(task);
+        pthread_barrier_wait(&pool->barrier);
+    }
+    return NULL;
+}
+#endif
+
+TrustAnalyzer::TrustAnalyzer()
+{
+    timer = NULL;
+    pool = NULL;
+}
+
+TrustAnalyzer::~TrustAnalyzer()
+{
+    cancelAndDelete(timer);
+    if(pool != NULL){
+#ifndef _WIN32
+        if(pool->workers > 0){
+            pool->stop = true;
+            pthread_barrier_wait(&pool->barrier);
+            for(int t=1; t<=pool->workers; t++) pthread_join(pool->ids[t], NULL);
+            pthread_barrier_destroy(&pool->barrier);
+        }
+        pthread_mutex_destroy(&pool->startLock);
+#endif
+        delete pool;
+    }
+}
+
+void TrustAnalyzer::initialize()
+{
+    interval      = par("interval");
+    alpha         = par("alpha");
+    maxIterations = par("maxIterations");
+    epsilon       = par("epsilon");
+    numThreads    = par("threads");
+#ifndef _WIN32
+    if(numThreads <= 0) numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if(numThreads <= 0) numThreads = 1;
+    // Los hilos se crean aquí una sola vez. Esperan a que esté la barrera,
+    // que se crea para los que hayan salido bien; si alguno no se puede
+    // crear su trozo lo hace el hilo principal.
+    pool = new WorkerPool();
+    pool->tasks.resize(numThreads);
+#ifndef _WIN32
+    pthread_mutex_init(&pool->startLock, NULL);
+    pthread_mutex_lock(&pool->startLock);
+    pool->ids.resize(numThreads);
+    for(int t=1; t<numThreads; t++){
+        pool->tasks[t].pool = pool;
+        if(pthread_create(&pool->ids[t], NULL, poolThread, &pool->tasks[t]) != 0){
+            EV << "No se pudo crear el hilo " << t << " de " << numThreads << ", sus filas las calcula el hilo principal" << endl;
+            break;
+        }
+        pool->workers++;
+    }
+    if(pool->workers > 0) pthread_barrier_init(&pool->barrier, NULL, pool->workers+1);
+    pthread_mutex_unlock(&pool->startLock);
+#endif
+    iterationsVector.setName("Iteraciones");
+    secondsVector.setName("Tiempo de calculo (s)");
+    aucVector.setName("Separacion de freeriders (AUC)");
+    goodTrustVector.setName("Confianza media de buenos");
+    freeriderTrustVector.setName("Confianza media de freeriders");
+    aucStats.setName("Separacion de freeriders");
+    timer = new cMessage("trustTimer");
+    scheduleAt(simTime()+interval, timer);
+}
+
+void TrustAnalyzer::handleMessage( cMessage *msg )
+{
+    double start = wallSeconds();
+    collectOpinions();
+    int iterations = computeTrust();
+    double seconds = wallSeconds() - start;
+    double goodMean, freeriderMean;
+    double auc = separation(goodMean, freeriderMean);
+    iterationsVector.record(iterations);
+    secondsVector.record(seconds);
+    aucVector.record(auc);
+    goodTrustVector.record(goodMean);
+    freeriderTrustVector.record(freeriderMean);
+    aucStats.collect(auc);
+    EV << "Confianza global: " << nodeIds.size() << " nodos, " << matrix.val.size() << " opiniones, "
+       << iterations << " iteraciones en " << seconds << "s, AUC " << auc << endl;
+    scheduleAt(simTime()+interval, timer);
+}
+
+void TrustAnalyzer::collectOpinions()
+{
+    // Nodos de la red, indexados por id de módulo para traducir los ids de
+    // las tablas de reputación a filas.
+    int lastId = simulation.getLastModuleId();
+    vector<int> row(lastId+1, -1);
+    vector<NoFreeNode *> nodes;
+    for(int id=0; id<=lastId; id++){
+        NoFreeNode *node = dynamic_cast<NoFreeNode *>(simulation.getModule(id));
+        if(node == NULL) continue;
+        row[id] = nodes.size();
+        nodes.push_back(node);
+    }
+    int n = nodes.size();
+    if(n != (int)nodeIds.size()) trust.clear();     // Ha cambiado la red: no se reutiliza.
+    nodeIds.resize(n);
+    freerider.resize(n);
+    dangling.assign(n, true);
+
+    // Opinión local de i sobre j (EigenTrust): max(aceptadas - no aceptadas, 0)
+    // normalizada por la suma de la fila de i. Se guardan como (j, i, c_ij).
+    vector< pair<int, PeerReputation> > entries;
+    vector<int> from, to;
+    vector<double> value;
+    vector<int> count(n, 0);
+    for(int i=0; i<n; i++){
+        nodeIds[i] = nodes[i]->getId();
+        freerider[i] = nodes[i]->isFreeriderNode();
+        entries.clear();
+        nodes[i]->getReputationStore().collect(entries);
+        size_t first = value.size();
+        double sum = 0;
+        for(unsigned int k=0; k<entries.size(); k++){
+            int peer = entries[k].first;
+            if(peer < 0 || peer > lastId || row[peer] < 0 || row[peer] == i) continue;
+            const PeerReputation &r = entries[k].second;
+            double s = 2.0*r.acceptedRequest - r.totalRequest;
+            if(s <= 0) continue;
+            from.push_back(i);
+            to.push_back(row[peer]);
+            value.push_back(s);
+            sum += s;
+        }
+        for(size_t k=first; k<value.size(); k++){
+            value[k] /= sum;
+            count[to[k]]++;
+        }
+        if(value.size() > first) dangling[i] = false;
+    }
+
+    // CSR de C^T por recuento: así cada fila j se calcula sin escribir en
+    // filas ajenas y los hilos no comparten nada al multiplicar.
+    matrix.rowStart.assign(n+1, 0);
+    for(int j=0; j<n; j++) matrix.rowStart[j+1] = matrix.rowStart[j] + count[j];
+    matrix.col.resize(value.size());
+    matrix.val.resize(value.size());
+    vector<int> next(matrix.rowStart.begin(), matrix.rowStart.end()-1);
+    for(size_t k=0; k<value.size(); k++){
+        int pos = next[to[k]]++;
+        matrix.col[pos] = from[k];
+        matrix.val[pos] = value[k];
+    }
+}
+
+double TrustAnalyzer::multiply( int begin, int end, const vector<double> &x, double base, vector<double> &y ) const
+{
+    const int *rowStart = &matrix.rowStart[0];
+    const int *col = matrix.col.empty()? NULL : &matrix.col[0];
+    const double *val = matrix.val.empty()? NULL : &matrix.val[0];
+    const double *in = &x[0];
+    double *out = &y[0];
+    double scale = 1 - alpha;
+    double diff = 0;
+    for(int j=begin; j<end; j++){
+        double sum = 0;
+        for(int k=rowStart[j]; k<rowStart[j+1]; k++) sum += val[k] * in[col[k]];
+        out[j] = scale*sum + base;
+        diff += fabs(out[j] - in[j]);
+    }
+    return diff;
+}
+
+int TrustAnalyzer::computeTrust()
+{
+    int n = nodeIds.size();
+    if(n == 0) return 0;
+    // Se arranca de la confianza del cálculo anterior (converge antes) o de la uniforme.
+    if((int)trust.size() != n) trust.assign(n, 1.0/n);
+    vector<double> next(n);
+    int threads = min(numThreads, max(1, n/1024));
+    vector<MultiplyTask> &tasks = pool->tasks;
+    int iteration = 0;
+    while(iteration < maxIterations){
+        iteration++;
+        // El peso de los nodos sin opiniones se reparte como el a priori.
+        double danglingMass = 0;
+        for(int i=0; i<n; i++) if(dangling[i]) danglingMass += trust[i];
+        double base = ((1 - alpha)*danglingMass + alpha) / n;
+        // Los trozos de más (si la red es pequeña se usan menos hilos) quedan vacíos.
+        for(int t=0; t<numThreads; t++){
+            MultiplyTask &task = tasks[t];
+            task.analyzer = this;
+            task.begin = (t < threads)? (long)n*t/threads : 0;
+            task.end   = (t < threads)? (long)n*(t+1)/threads : 0;
+            task.x = &trust;
+            task.base = base;
+            task.y = &next;
+            task.diff = 0;
+        }
+        // El pool hace los trozos 1..workers; el principal el 0 y los de los
+        // hilos que no se pudieron crear.
+        bool parallel = threads > 1 && pool->workers > 0;
+#ifndef _WIN32
+        if(parallel) pthread_barrier_wait(&pool->barrier);
+#endif
+        multiplyThread(&tasks[0]);
+        for(int t=(parallel? pool->workers+1 : 1); t<threads; t++) multiplyThread(&tasks[t]);
+#ifndef _WIN32
+        if(parallel) pthread_barrier_wait(&pool->barrier);
+#endif
+        double diff = 0;
+        for(int t=0; t<threads; t++) diff += tasks[t].diff;
+        trust.swap(next);
+        if(diff < epsilon) break;
+    }
+    return iteration;
+}
+
+double TrustAnalyzer::separation( double &goodMean, double &freeriderMean ) const
+{
+    // AUC por rangos: se ordenan los nodos por confianza y se cuentan los
+    // pares (bueno, freerider) bien ordenados; los empates cuentan medio.
+    int n = trust.size();
+    vector< pair<double, bool> > ranked(n);
+    long good = 0, bad = 0;
+    goodMean = freeriderMean = 0;
+    for(int i=0; i<n; i++){
+        ranked[i] = make_pair(trust[i], (bool)freerider[i]);
+        if(freerider[i]){ bad++; freeriderMean += trust[i]; }
+        else{ good++; goodMean += trust[i]; }
+    }
+    if(good) goodMean /= good;
+    if(bad) freeriderMean /= bad;
+    if(good == 0 || bad == 0) return 0.5;
+    sort(ranked.begin(), ranked.end());
+    double pairs = 0;
+    long badBelow = 0;
+    for(int i=0; i<n; ){
+        // Grupo de nodos con la misma confianza.
+        int j = i;
+        long groupBad = 0, groupGood = 0;
+        while(j < n && ranked[j].first == ranked[i].first){
+            if(ranked[j].second) groupBad++; else groupGood++;
+            j++;
+        }
+        pairs += groupGood * (badBelow + 0.5*groupBad);
+        badBelow += groupBad;
+        i = j;
+    }
+    return pairs / ((double)good * bad);
+}
+
+void TrustAnalyzer::finish()
+{
+    aucStats.record();
+}
@@ -0,0 +1,102 @@
+//
+// Copyright (c) 2013 Daniel Iñigo, Efren Suarez, Yuriy Batrakov, José Sklatz
+//
+// Permission is hereby granted, free of charge, to any
+// person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the
+// Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the
+// Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice
+// shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+// KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+// PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+// OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+//
+// file: TrustAnalyzer.h
+// author: Daniel Iñigo
+//
+
+#ifndef __TRUSTANALYZER_H_
+#define __TRUSTANALYZER_H_
+
+#include <vector>
+#include <omnetpp.h>
+using namespace std;
+
+struct WorkerPool;
+
+/**
+ * Análisis global de confianza: cada "interval" junta las tablas de
+ * reputación de todos los NoFreeNode en una matriz dispersa de opiniones
+ * (CSR), calcula la confianza global al estilo EigenTrust por iteración de
+ * potencias y mide lo bien que separa a los freeriders del resto.
+ *
+ * Es sólo una herramienta de análisis: mira directamente los módulos de
+ * todos los nodos, así que no vale en simulación paralela.
+ */
+class TrustAnalyzer : public cSimpleModule
+{
+protected:
+    /** Matriz C^T en CSR: la fila j tiene las opiniones normalizadas c_ij de cada i sobre j. */
+    struct SparseMatrix {
+        vector<int> rowStart;       // n+1 posiciones en col/val.
+        vector<int> col;            // Nodo i que opina.
+        vector<double> val;         // c_ij.
+    };
+
+    cMessage *timer;
+    simtime_t interval;
+    double alpha;                   // Peso de la confianza a priori (uniforme).
+    int maxIterations;
+    double epsilon;                 // Diferencia L1 con la que se da por convergida.
+    int numThreads;
+    WorkerPool *pool;               // Hilos del producto, creados una vez en initialize().
+
+    vector<int> nodeIds;            // Id de módulo de cada fila/columna.
+    vector<bool> freerider;         // Si el nodo es freerider.
+    vector<bool> dangling;          // Nodos sin ninguna opinión (su peso va al a priori).
+    SparseMatrix matrix;
+    vector<double> trust;           // Confianza global (se reutiliza como arranque).
+
+    cOutVector iterationsVector;
+    cOutVector secondsVector;
+    cOutVector aucVector;
+    cOutVector goodTrustVector;
+    cOutVector freeriderTrustVector;
+    cStdDev aucStats;
+
+    virtual void initialize ( );
+    virtual void handleMessage ( cMessage *msg );
+    virtual void finish ( );
+
+public:
+    TrustAnalyzer ( );
+    virtual ~TrustAnalyzer ( );
+
+    /** Junta las tablas de reputación de todos los nodos en la matriz. */
+    void collectOpinions ( );
+    /** Iteración de potencias; devuelve el nº de iteraciones hechas. */
+    int computeTrust ( );
+    /** y = C^T x en las filas [begin, end); devuelve la parte de sum|y - prev|. */
+    double multiply ( int begin, int end, const vector<double> &x, double base, vector<double> &y ) const;
+    /**
+     * Probabilidad de que un nodo bueno tenga más confianza que un freerider
+     * (AUC); 0.5 es no separar nada y 1 separarlos del todo.
+     */
+    double separation ( double &goodMean, double &freeriderMean ) const;
+};
+
+#endif
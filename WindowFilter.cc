@@ -0,0 +1,85 @@
+//
+// Copyright (c) 2013 Daniel Iñigo, Efren Suarez, Yuriy Batrakov, José Sklatz
+//
+// Permission is hereby granted, free of charge, to any
+// person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the
+// Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the
+// Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice
+// shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+// KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+// PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+// OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+//
+// file: WindowFilter.cc
+// author: Daniel Iñigo
+//
+
+#include <math.h>
+#include <omnetpp.h>
+
+#include "WindowFilter.h"
+
+Register_PerRunConfigOptionU(CFGID_NOFREE_STATS_WINDOW, "nofree-stats-window", "s", "1s",
+        "Longitud de las ventanas en las que el filtro window agrega las señales.");
+
+Register_ResultFilter("window", WindowFilter);
+
+WindowFilter::WindowFilter()
+{
+    window    = ev.getConfig()->getAsDouble(CFGID_NOFREE_STATS_WINDOW);
+    if(window <= 0) throw cRuntimeError("nofree-stats-window debe ser mayor que 0");
+    windowEnd = window;
+    sum       = 0;
+    empty     = true;
+}
+
+bool WindowFilter::process( simtime_t& t, double& value )
+{
+    // Mientras no se acabe la ventana sólo se acumula.
+    if(t < windowEnd){
+        sum += value;
+        empty = false;
+        return false;
+    }
+    // Se ha pasado de ventana: se deja salir la suma de la anterior (si
+    // hubo algo) y el valor actual abre la ventana que le toca.
+    double done = sum;
+    bool forward = !empty;
+    simtime_t doneEnd = windowEnd;
+    windowEnd = window * (floor(SIMTIME_DBL(t) / SIMTIME_DBL(window)) + 1);
+    while(windowEnd <= t) windowEnd += window;  // Por si el redondeo se queda corto.
+    sum   = value;
+    empty = false;
+    if(forward){
+        t = doneEnd;
+        value = done;
+    }
+    return forward;
+}
+
+void WindowFilter::finish( cResultFilter *prev )
+{
+    // La última ventana se queda a medias: se graba en el instante en que
+    // acaba la simulación, no al final de una ventana que no llegó a cerrarse.
+    if(!empty){
+        simtime_t end = (windowEnd < simTime())? windowEnd : simTime();
+        fire(this, end, sum);
+        empty = true;
+    }
+    cNumericResultFilter::finish(prev);
+}
@@ -0,0 +1,63 @@
+//
+// Copyright (c) 2013 Daniel Iñigo, Efren Suarez, Yuriy Batrakov, José Sklatz
+//
+// Permission is hereby granted, free of charge, to any
+// person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the
+// Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the
+// Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice
+// shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+// KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+// PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+// OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+//
+// file: WindowFilter.h
+// author: Daniel Iñigo
+//
+
+#ifndef __WINDOWFILTER_H_
+#define __WINDOWFILTER_H_
+
+#include <omnetpp.h>
+
+/**
+ * Filtro de resultados "window": suma los valores de una señal por ventanas
+ * de tiempo de simulación (opción "nofree-stats-window" del ini) y sólo deja
+ * pasar un valor por ventana, con la marca de tiempo del final de ésta. Así
+ * un vector(window) escribe un punto por ventana en lugar de uno por evento.
+ * Las ventanas en las que no llega nada no se escriben; la última, aunque
+ * no haya terminado, se escribe al acabar con la marca del final de la
+ * simulación.
+ */
+class WindowFilter : public cNumericResultFilter
+{
+protected:
+    simtime_t window;       // Longitud de la ventana.
+    simtime_t windowEnd;    // Fin de la ventana en curso.
+    double sum;             // Suma de la ventana en curso.
+    bool empty;             // Si en la ventana en curso no ha llegado nada.
+
+    virtual bool process ( simtime_t& t, double& value );
+
+    /** Al acabar la simulación deja salir la ventana en curso, que no se ha cerrado. */
+    virtual void finish ( cResultFilter *prev );
+
+public:
+    WindowFilter ( );
+};
+
+#endif
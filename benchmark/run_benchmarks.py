@@ -0,0 +1,249 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2013 Daniel Iñigo, Efren Suarez, Yuriy Batrakov, José Sklatz
+#
+# Permission is hereby granted, free of charge, to any
+# person obtaining a copy of this software and associated
+# documentation files (the "Software"), to deal in the
+# Software without restriction, including without limitation
+# the rights to use, copy, modify, merge, publish,
+# distribute, sublicense, and/or sell copies of the
+# Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice
+# shall be included in all copies or substantial portions of
+# the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+# KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+# WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+# PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+# OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+# OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+# OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+# SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+
+#
+# file: benchmark/run_benchmarks.py
+# author: Daniel Iñigo
+#
+
+"""
+Banco de pruebas reproducible del simulador.
+
+Ejecuta SmallNetwork, BigNetwork, LightNetwork y DenseNetwork con las
+configuraciones sin_solucion, con_solucion (reputación por consulta),
+con_solucion_cache (consulta con caché), con_solucion_anillo (consulta en
+anillos), con_solucion_push/_topk (por lotes), con_solucion_rueda (timers en
+la rueda de la red) y sin/con_solucion_trozos (archivos de 1MiB en trozos) de
+omnetpp.ini, en Cmdenv, con el mismo
+tiempo de simulación y la misma semilla. De cada ejecución guarda:
+eventos/s, tiempo real, memoria máxima, mensajes por tipo, fracción de
+peticiones de freeriders servidas y latencia media de decisión, opiniones por decisión y tasa de aciertos de la
+caché de opiniones, bytes de archivo entregados por segundo, tiempo medio de
+descarga completa y utilización media de los enlaces. Escribe un informe JSON y lo compara con
+el de referencia; si algún rendimiento empeora más que el umbral termina
+con código 1.
+
+Uso (desde la raíz del proyecto, con el simulador ya compilado):
+    python3 benchmark/run_benchmarks.py                     # mide y compara
+    python3 benchmark/run_benchmarks.py --update-baseline   # fija la referencia
+"""
+
+import argparse
+import json
+import os
+import re
+import shlex
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+NETWORKS = ["SmallNetwork", "BigNetwork", "LightNetwork", "DenseNetwork"]
+CONFIGS = ["sin_solucion", "con_solucion", "con_solucion_cache", "con_solucion_anillo",
+           "con_solucion_push", "con_solucion_push_topk", "con_solucion_rueda",
+           "sin_solucion_trozos", "con_solucion_trozos"]
+
+# Mensajes por tipo: escalar (suma de todos los nodos) de cada señal.
+MESSAGE_SCALARS = {
+    "FileRequest": "fileRequestReceived:count",
+    "ReputationRequest": "reputationRequestReceived:count",
+    "Reputation": "reputationReceived:count",
+    "File": "fileServed:count",
+    "ReputationDigest": "reputationDigestReceived:count",
+    "FileAck": "Confirmaciones de trozo recibidas",
+}
+
+# Métricas de rendimiento que se comparan con la referencia y en qué
+# sentido es peor: +1 si peor es mayor, -1 si peor es menor.
+PERF_METRICS = {
+    "events_per_sec": -1,
+    "wall_seconds": +1,
+    "peak_rss_kb": +1,
+}
+
+
+def parse_scalars(sca_path):
+    """Suma por nombre los escalares de todos los módulos de un .sca."""
+    totals = {}
+    with open(sca_path) as f:
+        for line in f:
+            if not line.startswith("scalar "):
+                continue
+            fields = shlex.split(line)
+            if len(fields) < 4:
+                continue
+            name, value = fields[2], fields[3]
+            try:
+                totals[name] = totals.get(name, 0.0) + float(value)
+            except ValueError:
+                pass
+    return totals
+
+
+def sim_seconds(sim_time):
+    """Segundos de un tiempo de simulación como "600s", "10min" o "1h"."""
+    units = [("ms", 1e-3), ("min", 60.0), ("s", 1.0), ("h", 3600.0)]
+    for unit, factor in units:
+        if sim_time.endswith(unit):
+            return float(sim_time[:-len(unit)]) * factor
+    return float(sim_time)
+
+
+def run_one(exe, network, config, sim_time, seed_set):
+    """Ejecuta una simulación y devuelve sus métricas."""
+    result_dir = tempfile.mkdtemp(prefix="nofree-bench-")
+    cmd = [exe, "-u", "Cmdenv", "-c", config, "-n", ".",
+           "--network=%s" % network,
+           "--sim-time-limit=%s" % sim_time,
+           "--seed-set=%d" % seed_set,
+           "--cmdenv-express-mode=true",
+           "--record-eventlog=false",
+           "--result-dir=%s" % result_dir]
+    # La salida va a un fichero para poder esperar al proceso con wait4(),
+    # que devuelve la memoria máxima de ese hijo en concreto.
+    with tempfile.TemporaryFile(mode="w+") as out:
+        start = time.perf_counter()
+        proc = subprocess.Popen(cmd, stdout=out, stderr=subprocess.STDOUT)
+        _, status, usage = os.wait4(proc.pid, 0)
+        wall = time.perf_counter() - start
+        proc.returncode = os.waitstatus_to_exitcode(status)
+        out.seek(0)
+        output = out.read()
+    peak_rss_kb = usage.ru_maxrss
+    if proc.returncode != 0:
+        sys.stderr.write(output)
+        raise RuntimeError("falló %s/%s (código %d)" % (network, config, proc.returncode))
+
+    events = [int(n) for n in re.findall(r"event #(\d+)", output)]
+    events = events[-1] if events else 0
+
+    scalars = {}
+    for name in os.listdir(result_dir):
+        if name.endswith(".sca"):
+            scalars = parse_scalars(os.path.join(result_dir, name))
+    shutil.rmtree(result_dir, ignore_errors=True)
+    messages = dict((k, int(scalars.get(v, 0))) for k, v in MESSAGE_SCALARS.items())
+    fr_requests = scalars.get("freeriderRequestReceived:count", 0)
+    fr_served = scalars.get("freeriderServed:count", 0)
+    decisions = scalars.get("Decisiones", 0)
+    decision_time = scalars.get("Latencia de decision acumulada (s)", 0)
+    cache_hits = scalars.get("Aciertos de cache de opiniones", 0)
+    opinions = scalars.get("Opiniones reunidas", 0)
+    cache_misses = scalars.get("Fallos de cache de opiniones", 0)
+    transfers = scalars.get("Descargas completas", 0)
+    transfer_time = scalars.get("Tiempo de transferencia acumulado (s)", 0)
+    links = scalars.get("Enlaces", 0)
+    busy = scalars.get("Tiempo de transmision (s)", 0)
+    seconds = sim_seconds(sim_time)
+
+    return {
+        "network": network,
+        "config": config,
+        "events": events,
+        "wall_seconds": wall,
+        "events_per_sec": events / wall if wall > 0 else 0,
+        "peak_rss_kb": peak_rss_kb,
+        "messages": messages,
+        "freerider_served_fraction": fr_served / fr_requests if fr_requests else 0,
+        "decision_latency": decision_time / decisions if decisions else 0,
+        "opinions_per_decision": opinions / decisions if decisions else 0,
+        "opinion_cache_hit_rate": cache_hits / (cache_hits + cache_misses) if cache_hits + cache_misses else 0,
+        "delivered_bytes_per_sec": scalars.get("Bytes recibidos", 0) / seconds if seconds else 0,
+        "transfer_time": transfer_time / transfers if transfers else 0,
+        "link_utilization": busy / (links * seconds) if links and seconds else 0,
+    }
+
+
+def compare(report, baseline, threshold):
+    """Devuelve la lista de regresiones respecto a la referencia."""
+    base = dict(((r["network"], r["config"]), r) for r in baseline["runs"])
+    regressions = []
+    for run in report["runs"]:
+        ref = base.get((run["network"], run["config"]))
+        if ref is None:
+            continue
+        for metric, worse in PERF_METRICS.items():
+            old, new = ref.get(metric, 0), run.get(metric, 0)
+            if old <= 0:
+                continue
+            change = (new - old) / old
+            run.setdefault("change", {})[metric] = change
+            if change * worse > threshold:
+                regressions.append("%s/%s: %s %.4g -> %.4g (%+.1f%%)" % (
+                    run["network"], run["config"], metric, old, new, 100 * change))
+    return regressions
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("--exe", default="./nofreeriders", help="ejecutable del simulador")
+    parser.add_argument("--sim-time", default="600s", help="tiempo de simulación de cada ejecución")
+    parser.add_argument("--seed-set", type=int, default=0, help="conjunto de semillas")
+    parser.add_argument("--networks", nargs="+", default=NETWORKS)
+    parser.add_argument("--configs", nargs="+", default=CONFIGS)
+    parser.add_argument("--report", default=os.path.join(here, "report.json"))
+    parser.add_argument("--baseline", default=os.path.join(here, "baseline.json"))
+    parser.add_argument("--threshold", type=float, default=0.10,
+                        help="empeoramiento relativo tolerado (0.10 = 10%%)")
+    parser.add_argument("--update-baseline", action="store_true",
+                        help="guarda este informe como referencia")
+    args = parser.parse_args()
+
+    report = {"sim_time": args.sim_time, "seed_set": args.seed_set, "runs": []}
+    for network in args.networks:
+        for config in args.configs:
+            run = run_one(args.exe, network, config, args.sim_time, args.seed_set)
+            report["runs"].append(run)
+            print("%-13s %-22s %10.0f ev/s %8.2fs %8d kB  %8d msg  freeriders servidos %.3f  decisión %.4fs  %10.0f B/s" % (
+                network, config, run["events_per_sec"], run["wall_seconds"],
+                run["peak_rss_kb"], sum(run["messages"].values()),
+                run["freerider_served_fraction"], run["decision_latency"],
+                run["delivered_bytes_per_sec"]))
+
+    regressions = []
+    if args.update_baseline:
+        with open(args.baseline, "w") as f:
+            json.dump(report, f, indent=2, sort_keys=True)
+        print("Referencia guardada en %s" % args.baseline)
+    elif os.path.exists(args.baseline):
+        with open(args.baseline) as f:
+            regressions = compare(report, json.load(f), args.threshold)
+    else:
+        print("No hay referencia (%s), ejecuta con --update-baseline" % args.baseline)
+
+    report["regressions"] = regressions
+    with open(args.report, "w") as f:
+        json.dump(report, f, indent=2, sort_keys=True)
+    for r in regressions:
+        print("REGRESIÓN: " + r)
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,328 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2013 Daniel Iñigo, Efren Suarez, Yuriy Batrakov, José Sklatz
+#
+# Permission is hereby granted, free of charge, to any
+# person obtaining a copy of this software and associated
+# documentation files (the "Software"), to deal in the
+# Software without restriction, including without limitation
+# the rights to use, copy, modify, merge, publish,
+# distribute, sublicense, and/or sell copies of the
+# Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice
+# shall be included in all copies or substantial portions of
+# the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+# KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+# WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+# PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+# OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+# OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+# OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+# SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+
+#
+# file: benchmark/run_sweep.py
+# author: Daniel Iñigo
+#
+
+"""
+Ejecuta en paralelo todas las ejecuciones de un barrido de parámetros.
+
+Expande las configuraciones de omnetpp.ini indicadas (sus variables de
+iteración y repeticiones) en una lista de ejecuciones y las reparte entre
+tantos procesos como núcleos. Cada trabajador tiene su propia cola, ordenada
+de la más larga a la más corta, y cuando se queda sin trabajo roba la
+ejecución más corta de la cola más cargada, para que las ejecuciones largas
+no se queden solas al final. La duración de cada ejecución se estima con la
+de las ejecuciones ya hechas con las mismas variables (otras repeticiones o
+barridos anteriores) y, si no hay ninguna, con el tamaño de la red.
+
+Según acaba cada ejecución, sus escalares de toda la red (los contadores
+sumados sobre los módulos, los ratios y tasas promediados y los máximos con
+el mayor) se añaden a un único CSV (config, ejecución, variables de
+iteración, escalar, valor) y se apunta en el diario. Si el barrido se interrumpe, al volver a
+lanzarlo se saltan las ejecuciones del diario y se descartan las filas de
+las que quedaron a medias.
+
+Uso (desde la raíz del proyecto, con el simulador ya compilado):
+    python3 benchmark/run_sweep.py -c barrido                 # todos los núcleos
+    python3 benchmark/run_sweep.py -c barrido -j 4 --out res  # 4 procesos
+"""
+
+import argparse
+import csv
+import os
+import re
+import shlex
+import shutil
+import subprocess
+import sys
+import threading
+import time
+
+JOURNAL = "journal.tsv"
+RESULTS = "results.csv"
+COLUMNS = ["config", "run", "itervars", "scalar", "value"]
+
+# Escalares por módulo que no se suman sobre la red: los ratios y tasas se
+# promedian y los máximos se quedan con el mayor.
+MEAN_PREFIXES = ("Ratio ", "Tasa ", "Temporizadores por lote")
+MAX_PREFIXES = ("Maximo ", "Memoria maxima")
+
+# Aristas de cada red fija, para estimar la duración sin barridos anteriores.
+NETWORK_EDGES = {"SmallNetwork": 20, "BigNetwork": 60,
+                 "LightNetwork": 1200, "DenseNetwork": 3000}
+
+
+def list_runs(exe, config):
+    """Ejecuciones de una configuración (según el simulador): [(nº, variables)],
+    con las variables de iteración sin la repetición, como '$red=..., $tasa=...'."""
+    output = subprocess.run([exe, "-u", "Cmdenv", "-x", config, "-g", "-n", "."],
+                            stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                            universal_newlines=True).stdout
+    m = re.search(r"Number of runs:\s*(\d+)", output)
+    if not m:
+        sys.stderr.write(output)
+        raise RuntimeError("no se pudo expandir la configuración %s" % config)
+    variables = {}
+    for run, line in re.findall(r"^Run (\d+): (.*)$", output, re.M):
+        fields = [v.strip() for v in line.split(",") if not v.strip().startswith("$repetition=")]
+        variables[int(run)] = ", ".join(fields)
+    return [(r, variables.get(r, "")) for r in range(int(m.group(1)))]
+
+
+def network_size(variables):
+    """Tamaño aproximado de la red de una ejecución (1 si no se sabe)."""
+    for field in variables.split(","):
+        name, _, value = field.strip().partition("=")
+        if value in NETWORK_EDGES:
+            return NETWORK_EDGES[value]
+        if name == "$nodos" and value.isdigit():
+            return int(value)
+    return 1
+
+
+def read_scalars(sca_path):
+    """Escalares de toda la red a partir de los de cada módulo de un .sca."""
+    totals, counts = {}, {}
+    with open(sca_path) as f:
+        for line in f:
+            if not line.startswith("scalar "):
+                continue
+            fields = shlex.split(line)
+            if len(fields) < 4:
+                continue
+            name = fields[2]
+            try:
+                value = float(fields[3])
+            except ValueError:
+                continue
+            if value != value:      # nan (p.ej. un ratio sin peticiones)
+                continue
+            if name.startswith(MAX_PREFIXES):
+                totals[name] = max(totals.get(name, value), value)
+            else:
+                totals[name] = totals.get(name, 0.0) + value
+            counts[name] = counts.get(name, 0) + 1
+    for name in totals:
+        if name.startswith(MEAN_PREFIXES):
+            totals[name] /= counts[name]
+    return totals
+
+
+def read_itervars(sca_path):
+    """Variables de iteración de la ejecución, como 'a=1, b=2'."""
+    itervars = []
+    attr = ""
+    with open(sca_path) as f:
+        for line in f:
+            if line.startswith("itervar "):
+                parts = line.split(None, 2)
+                if len(parts) == 3:
+                    itervars.append("%s=%s" % (parts[1], parts[2].strip().strip('"')))
+            elif line.startswith("attr iterationvars "):
+                attr = line.split(None, 2)[2].strip().strip('"')
+            elif line.startswith("scalar "):
+                break
+    return ", ".join(itervars) if itervars else attr
+
+
+def load_journal(out_dir):
+    """Ejecuciones ya terminadas: {(config, run): (segundos, variables)}."""
+    done = {}
+    path = os.path.join(out_dir, JOURNAL)
+    if os.path.exists(path):
+        with open(path) as f:
+            for line in f:
+                fields = line.rstrip("\n").split("\t")
+                if len(fields) in (3, 4):
+                    variables = fields[3] if len(fields) == 4 else ""
+                    done[(fields[0], int(fields[1]))] = (float(fields[2]), variables)
+    return done
+
+
+def drop_partial_rows(out_dir, done):
+    """Quita del CSV las filas de ejecuciones que no llegaron al diario."""
+    path = os.path.join(out_dir, RESULTS)
+    if not os.path.exists(path):
+        return
+    with open(path, newline="") as f:
+        rows = [r for r in csv.DictReader(f) if (r["config"], int(r["run"])) in done]
+    with open(path + ".tmp", "w", newline="") as f:
+        writer = csv.DictWriter(f, fieldnames=COLUMNS)
+        writer.writeheader()
+        writer.writerows(rows)
+    os.replace(path + ".tmp", path)
+
+
+class Scheduler:
+    """Colas por trabajador con robo de trabajo (todo bajo un único cerrojo)."""
+
+    def __init__(self, tasks, workers):
+        self.lock = threading.Lock()
+        self.queues = [[] for _ in range(workers)]
+        # Las más largas primero y repartidas en turno: cada cola queda
+        # ordenada de larga a corta y se sirve por el principio.
+        for i, task in enumerate(tasks):
+            self.queues[i % workers].append(task)
+
+    def next(self, worker):
+        with self.lock:
+            own = self.queues[worker]
+            if own:
+                return own.pop(0)
+            # Sin trabajo propio: se roba la más corta de la cola más cargada.
+            victim = max(self.queues, key=len)
+            return victim.pop() if victim else None
+
+
+class Sweep:
+    def __init__(self, args):
+        self.args = args
+        self.lock = threading.Lock()
+        self.failed = []
+        self.finished = 0
+
+    def run_one(self, config, run):
+        """Ejecuta una simulación y devuelve (segundos, itervars, escalares)."""
+        result_dir = os.path.join(self.args.out, "runs", "%s-%d" % (config, run))
+        shutil.rmtree(result_dir, ignore_errors=True)
+        os.makedirs(result_dir)
+        cmd = [self.args.exe, "-u", "Cmdenv", "-c", config, "-r", str(run), "-n", ".",
+               "--cmdenv-express-mode=true",
+               "--record-eventlog=false",
+               "--result-dir=%s" % result_dir]
+        start = time.perf_counter()
+        with open(os.path.join(result_dir, "salida.txt"), "w") as log:
+            code = subprocess.call(cmd, stdout=log, stderr=subprocess.STDOUT)
+        seconds = time.perf_counter() - start
+        if code != 0:
+            raise RuntimeError("código %d, ver %s" % (code, result_dir))
+        itervars, scalars = "", {}
+        for name in os.listdir(result_dir):
+            if name.endswith(".sca"):
+                sca = os.path.join(result_dir, name)
+                itervars = read_itervars(sca)
+                scalars = read_scalars(sca)
+        if not self.args.keep_runs:
+            shutil.rmtree(result_dir, ignore_errors=True)
+        return seconds, itervars, scalars
+
+    def record(self, config, run, variables, seconds, itervars, scalars):
+        """Añade las filas de la ejecución al CSV y después la apunta en el diario."""
+        with self.lock:
+            results = os.path.join(self.args.out, RESULTS)
+            new = not os.path.exists(results)
+            with open(results, "a", newline="") as f:
+                writer = csv.writer(f)
+                if new:
+                    writer.writerow(COLUMNS)
+                for name in sorted(scalars):
+                    writer.writerow([config, run, itervars, name, repr(scalars[name])])
+                f.flush()
+                os.fsync(f.fileno())
+            with open(os.path.join(self.args.out, JOURNAL), "a") as f:
+                f.write("%s\t%d\t%.3f\t%s\n" % (config, run, seconds, variables))
+            self.finished += 1
+
+    def worker(self, index, scheduler, total):
+        while True:
+            task = scheduler.next(index)
+            if task is None:
+                return
+            config, run, variables = task
+            try:
+                seconds, itervars, scalars = self.run_one(config, run)
+            except Exception as e:
+                with self.lock:
+                    self.failed.append((config, run, str(e)))
+                print("FALLO %s #%d: %s" % (config, run, e))
+                continue
+            self.record(config, run, variables, seconds, itervars, scalars)
+            print("[%d/%d] %s #%d (%s) %.1fs" % (self.finished, total, config, run,
+                                                 itervars or "-", seconds))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("-c", "--config", action="append", required=True,
+                        help="configuración de omnetpp.ini (se puede repetir)")
+    parser.add_argument("-j", "--jobs", type=int, default=os.cpu_count() or 1,
+                        help="simulaciones a la vez (por defecto, una por núcleo)")
+    parser.add_argument("--exe", default="./nofreeriders", help="ejecutable del simulador")
+    parser.add_argument("--out", default="sweep", help="directorio del CSV y del diario")
+    parser.add_argument("--keep-runs", action="store_true",
+                        help="conserva los .sca/.vec de cada ejecución en OUT/runs")
+    args = parser.parse_args()
+
+    os.makedirs(args.out, exist_ok=True)
+    done = load_journal(args.out)
+    drop_partial_rows(args.out, done)
+
+    # Duración estimada de cada ejecución: la media de las ya hechas con las
+    # mismas variables (las repeticiones sólo cambian la semilla). Si no hay
+    # ninguna, el tamaño de la red por los segundos por arista medidos (o 1).
+    measured = {}
+    per_edge = []
+    for (config, run), (seconds, variables) in done.items():
+        if variables:
+            measured.setdefault((config, variables), []).append(seconds)
+        per_edge.append(seconds / network_size(variables))
+    per_edge = sorted(per_edge)[len(per_edge) // 2] if per_edge else 1.0
+
+    def estimate(task):
+        config, run, variables = task
+        seconds = measured.get((config, variables))
+        if seconds:
+            return sum(seconds) / len(seconds)
+        return network_size(variables) * per_edge
+
+    tasks = []
+    for config in args.config:
+        tasks += [(config, r, v) for r, v in list_runs(args.exe, config)
+                  if (config, r) not in done]
+    tasks.sort(key=estimate, reverse=True)
+    print("%d ejecuciones pendientes (%d ya hechas), %d procesos" % (len(tasks), len(done), args.jobs))
+
+    sweep = Sweep(args)
+    scheduler = Scheduler(tasks, max(1, args.jobs))
+    threads = [threading.Thread(target=sweep.worker, args=(i, scheduler, len(tasks)))
+               for i in range(max(1, args.jobs))]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+
+    for config, run, error in sweep.failed:
+        print("FALLO %s #%d: %s" % (config, run, error))
+    print("Resultados en %s" % os.path.join(args.out, RESULTS))
+    return 1 if sweep.failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
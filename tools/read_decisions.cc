@@ -0,0 +1,223 @@
+//
+// Copyright (c) 2013 Daniel Iñigo, Efren Suarez, Yuriy Batrakov, José Sklatz
+//
+// Permission is hereby granted, free of charge, to any
+// person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the
+// Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the
+// Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice
+// shall be included in all copies or substantial portions of
+// the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+// KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+// PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+// OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+//
+// file: tools/read_decisions.cc
+// author: Daniel Iñigo
+//
+
+//
+// Lee el registro de decisiones de una ejecución (nofree-decision-log) y
+// calcula sus agregados en una sola pasada sobre las columnas mapeadas en
+// memoria. No depende de OmNet++:
+//
+//     make tools
+//     tools/read_decisions results/con_solucion-0 [otra base...]
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "../DecisionLogFormat.h"
+
+using namespace std;
+
+/**
+ * Fichero de una columna en memoria (mapeado o, sin mmap, leído entero).
+ */
+struct ColumnFile {
+    const char *data;
+    size_t size;
+    const char *values;     // Primer valor (detrás de la cabecera).
+    size_t count;           // Nº de valores.
+    ColumnFile() : data(NULL), size(0), values(NULL), count(0) { }
+};
+
+static bool mapColumn( const string &file, int column, ColumnFile &col )
+{
+#ifndef _WIN32
+    int fd = open(file.c_str(), O_RDONLY);
+    if(fd < 0) return false;
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(DecisionLogHeader)){
+        close(fd);
+        return false;
+    }
+    col.size = st.st_size;
+    void *p = mmap(NULL, col.size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(p == MAP_FAILED) return false;
+    // Se recorre de principio a fin.
+    madvise(p, col.size, MADV_SEQUENTIAL);
+    col.data = (const char *)p;
+#else
+    FILE *f = fopen(file.c_str(), "rb");
+    if(f == NULL) return false;
+    fseek(f, 0, SEEK_END);
+    col.size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *buffer = (char *)malloc(col.size);
+    bool ok = buffer != NULL && col.size >= sizeof(DecisionLogHeader) && fread(buffer, 1, col.size, f) == col.size;
+    fclose(f);
+    if(!ok){
+        free(buffer);
+        return false;
+    }
+    col.data = buffer;
+#endif
+    const DecisionLogHeader *header = (const DecisionLogHeader *)col.data;
+    unsigned int width = decisionColumnWidth(column);
+    if(memcmp(header->magic, "NOFREEDL", sizeof(header->magic)) != 0 || header->version != DL_VERSION
+            || header->width != width || strncmp(header->column, decisionColumnName(column), sizeof(header->column)) != 0){
+        fprintf(stderr, "%s: no es la columna %s de un registro de decisiones\n", file.c_str(), decisionColumnName(column));
+        return false;
+    }
+    col.values = col.data + sizeof(DecisionLogHeader);
+    col.count  = (col.size - sizeof(DecisionLogHeader)) / width;
+    return true;
+}
+
+static void unmapColumn( ColumnFile &col )
+{
+    if(col.data == NULL) return;
+#ifndef _WIN32
+    munmap((void *)col.data, col.size);
+#else
+    free((void *)col.data);
+#endif
+    col.data = NULL;
+}
+
+/** Marca id en seen y devuelve 1 si no lo estaba. */
+static int mark( vector<char> &seen, int id )
+{
+    if(id < 0) return 0;
+    if(id >= (int)seen.size()) seen.resize(2*id + 1, 0);
+    if(seen[id]) return 0;
+    seen[id] = 1;
+    return 1;
+}
+
+static double fraction( long a, long b )
+{
+    return b? (double)a/b : 0;
+}
+
+static bool summarize( const string &base )
+{
+    ColumnFile cols[DL_NUM_COLUMNS];
+    bool ok = true;
+    for(int c=0; c<DL_NUM_COLUMNS && ok; c++){
+        string file = base + "." + decisionColumnName(c) + ".col";
+        ok = mapColumn(file, c, cols[c]);
+        if(!ok && cols[c].data == NULL) fprintf(stderr, "No se puede leer %s\n", file.c_str());
+    }
+    // Si se cortó a medias de un volcado se usan las decisiones completas.
+    size_t n = ok? cols[0].count : 0;
+    for(int c=1; c<DL_NUM_COLUMNS && ok; c++){
+        if(cols[c].count < n) n = cols[c].count;
+    }
+
+    const double  *time      = (const double  *)cols[DL_TIME].values;
+    const int32_t *requester = (const int32_t *)cols[DL_REQUESTER].values;
+    const int32_t *server    = (const int32_t *)cols[DL_SERVER].values;
+    const int32_t *total     = (const int32_t *)cols[DL_TOTAL].values;
+    const int32_t *accepted  = (const int32_t *)cols[DL_ACCEPTED].values;
+    const double  *ratio     = (const double  *)cols[DL_RATIO].values;
+    const uint8_t *outcome   = (const uint8_t *)cols[DL_OUTCOME].values;
+
+    long served = 0, newNode = 0, noQuery = 0;
+    long freerider = 0, freeriderServed = 0, honestServed = 0;
+    long ratios = 0, requesters = 0, servers = 0;
+    double sumTotal = 0, sumAccepted = 0, sumRatio = 0;
+    double first = 0, last = 0;
+    vector<char> seenRequester, seenServer;
+    for(size_t k=0; k<n; k++){
+        int o = outcome[k];
+        bool s = (o & DL_SERVED) != 0;
+        served  += s;
+        newNode += (o & DL_NEW_NODE) != 0;
+        noQuery += (o & DL_NO_QUERY) != 0;
+        if(o & DL_FREERIDER){
+            freerider++;
+            freeriderServed += s;
+        }
+        else honestServed += s;
+        sumTotal    += total[k];
+        sumAccepted += accepted[k];
+        if(!isnan(ratio[k]) && !isinf(ratio[k])){
+            sumRatio += ratio[k];
+            ratios++;
+        }
+        requesters += mark(seenRequester, requester[k]);
+        servers    += mark(seenServer, server[k]);
+        if(k == 0 || time[k] < first) first = time[k];
+        if(k == 0 || time[k] > last) last = time[k];
+    }
+    for(int c=0; c<DL_NUM_COLUMNS; c++) unmapColumn(cols[c]);
+    if(!ok) return false;
+
+    long honest = n - freerider;
+    printf("%s\n", base.c_str());
+    printf("  decisiones                %lu\n", (unsigned long)n);
+    printf("  intervalo (s)             %g - %g\n", first, last);
+    printf("  decisiones por segundo    %g\n", last > first? n / (last - first) : 0);
+    printf("  nodos que piden           %ld\n", requesters);
+    printf("  nodos que deciden         %ld\n", servers);
+    printf("  servidas                  %ld (%.4f)\n", served, fraction(served, n));
+    printf("  servidas a freeriders     %ld de %ld (%.4f)\n", freeriderServed, freerider, fraction(freeriderServed, freerider));
+    printf("  servidas al resto         %ld de %ld (%.4f)\n", honestServed, honest, fraction(honestServed, honest));
+    printf("  nodos nuevos              %ld (%.4f)\n", newNode, fraction(newNode, n));
+    printf("  sin consultar             %ld (%.4f)\n", noQuery, fraction(noQuery, n));
+    printf("  peticiones reunidas       %g de media\n", n? sumTotal / n : 0);
+    printf("  aceptadas reunidas        %g de media\n", n? sumAccepted / n : 0);
+    printf("  ratio medio               %g (de %ld con reputación)\n", ratios? sumRatio / ratios : 0, ratios);
+    return true;
+}
+
+int main( int argc, char **argv )
+{
+    if(argc < 2){
+        fprintf(stderr, "Uso: %s <base> [<base>...]\n"
+                "  (la base es el valor de nofree-decision-log de la ejecución)\n", argv[0]);
+        return 2;
+    }
+    int rc = 0;
+    for(int i=1; i<argc; i++){
+        if(!summarize(argv[i])) rc = 1;
+    }
+    return rc;
+}